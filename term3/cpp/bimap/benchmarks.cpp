@@ -0,0 +1,400 @@
+#include "bimap.h"
+#include "concurrent_bimap.h"
+#include <algorithm>
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#if __has_include(<boost/bimap.hpp>)
+#include <boost/bimap.hpp>
+#define HAVE_BOOST_BIMAP
+#endif
+
+// Все выделения памяти в программе считаются, чтобы печатать allocs/op
+namespace {
+std::atomic<std::size_t> allocations = 0;
+} // namespace
+
+void* operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void* operator new(std::size_t size, std::align_val_t align) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  auto a = static_cast<std::size_t>(align);
+  if (void* p = std::aligned_alloc(a, (size + a - 1) / a * a)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+void operator delete(void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+namespace {
+// Однопоточные операции. Каждая реализация заворачивается в адаптер с
+// одинаковым интерфейсом; пары всегда вида (k, -k), ключи -- 0..n-1.
+
+template <typename Map>
+struct bimap_adapter {
+  Map map;
+
+  bimap_adapter() = default;
+  explicit bimap_adapter(std::vector<std::pair<int, int>> const& pairs)
+      : map(pairs.begin(), pairs.end()) {}
+
+  void insert(int left, int right) {
+    map.insert(left, right);
+  }
+  bool find(int left) {
+    return map.find_left(left) != map.end_left();
+  }
+  bool erase(int left) {
+    return map.erase_left(left);
+  }
+  long long sum() const {
+    long long res = 0;
+    for (auto it = map.begin_left(); it != map.end_left(); ++it) {
+      res += *it;
+    }
+    return res;
+  }
+};
+
+// то, что пишут вместо bimap без него: два std::map в обе стороны
+struct std_maps {
+  std::map<int, int> left, right;
+
+  std_maps() = default;
+  explicit std_maps(std::vector<std::pair<int, int>> const& pairs) {
+    for (auto [l, r] : pairs) {
+      insert(l, r);
+    }
+  }
+
+  void insert(int l, int r) {
+    auto [it, inserted] = left.emplace(l, r);
+    if (inserted && !right.emplace(r, l).second) {
+      left.erase(it);
+    }
+  }
+  bool find(int l) {
+    return left.find(l) != left.end();
+  }
+  bool erase(int l) {
+    auto it = left.find(l);
+    if (it == left.end()) {
+      return false;
+    }
+    right.erase(it->second);
+    left.erase(it);
+    return true;
+  }
+  long long sum() const {
+    long long res = 0;
+    for (auto const& p : left) {
+      res += p.first;
+    }
+    return res;
+  }
+};
+
+#ifdef HAVE_BOOST_BIMAP
+struct boost_bimap {
+  boost::bimap<int, int> map;
+
+  boost_bimap() = default;
+  explicit boost_bimap(std::vector<std::pair<int, int>> const& pairs) {
+    for (auto [l, r] : pairs) {
+      insert(l, r);
+    }
+  }
+
+  void insert(int l, int r) {
+    map.insert({l, r});
+  }
+  bool find(int l) {
+    return map.left.find(l) != map.left.end();
+  }
+  bool erase(int l) {
+    return map.left.erase(l) != 0;
+  }
+  long long sum() const {
+    long long res = 0;
+    for (auto const& p : map.left) {
+      res += p.first;
+    }
+    return res;
+  }
+};
+#endif
+
+// Порядок ключей, в котором идут операции:
+// sequential -- по возрастанию, random -- случайная перестановка,
+// zipf -- n выборок с P(k-й по популярности) ~ 1/k, популярные ключи
+// разбросаны по всему диапазону. Для вставки и удаления это значит много
+// повторов: вставка уже существующего и удаление отсутствующего ключа.
+enum pattern { SEQUENTIAL, RANDOM, ZIPF };
+char const* const PATTERN_NAMES[] = {"sequential", "random", "zipf"};
+
+std::vector<int> make_keys(pattern p, int n) {
+  std::vector<int> keys(n);
+  std::iota(keys.begin(), keys.end(), 0);
+  if (p == SEQUENTIAL) {
+    return keys;
+  }
+  std::mt19937 e(n);
+  std::shuffle(keys.begin(), keys.end(), e);
+  if (p == RANDOM) {
+    return keys;
+  }
+  // непрерывное распределение с плотностью 1/x, округленное вниз
+  std::uniform_real_distribution<double> u;
+  std::vector<int> res(n);
+  for (int& k : res) {
+    int rank = static_cast<int>(std::exp(u(e) * std::log(n + 1.)) - 1);
+    k = keys[std::min(rank, n - 1)];
+  }
+  return res;
+}
+
+std::vector<std::pair<int, int>> make_pairs(int n) {
+  std::vector<std::pair<int, int>> pairs;
+  pairs.reserve(n);
+  for (int i = 0; i < n; i++) {
+    pairs.emplace_back(i, -i);
+  }
+  return pairs;
+}
+
+// Время и выделения на одну операцию. Время на построение и разрушение
+// контейнера вокруг замеряемых операций не считается, выделения тоже.
+class per_op {
+  benchmark::State& state;
+  std::size_t ops = 0;
+  std::size_t allocs = 0;
+  std::size_t start;
+
+public:
+  explicit per_op(benchmark::State& state) : state(state) {}
+
+  void resume() {
+    state.ResumeTiming();
+    start = allocations.load(std::memory_order_relaxed);
+  }
+  void pause(std::size_t done) {
+    allocs += allocations.load(std::memory_order_relaxed) - start;
+    state.PauseTiming();
+    ops += done;
+  }
+  ~per_op() {
+    state.SetItemsProcessed(ops);
+    state.counters["time/op"] =
+        benchmark::Counter(ops, benchmark::Counter::kIsRate |
+                                    benchmark::Counter::kInvert);
+    state.counters["allocs/op"] = ops == 0 ? 0. : double(allocs) / ops;
+  }
+};
+
+template <typename Map>
+void insert(benchmark::State& state, pattern p) {
+  auto keys = make_keys(p, state.range(0));
+  per_op meter(state);
+  for (auto _ : state) {
+    state.PauseTiming();
+    {
+      Map map;
+      meter.resume();
+      for (int k : keys) {
+        map.insert(k, -k);
+      }
+      meter.pause(keys.size());
+    }
+    state.ResumeTiming();
+  }
+}
+
+template <typename Map>
+void find(benchmark::State& state, pattern p) {
+  int n = state.range(0);
+  auto keys = make_keys(p, n);
+  Map map(make_pairs(n));
+  per_op meter(state);
+  for (auto _ : state) {
+    state.PauseTiming();
+    meter.resume();
+    for (int k : keys) {
+      benchmark::DoNotOptimize(map.find(k));
+    }
+    meter.pause(keys.size());
+    state.ResumeTiming();
+  }
+}
+
+template <typename Map>
+void erase(benchmark::State& state, pattern p) {
+  int n = state.range(0);
+  auto keys = make_keys(p, n);
+  auto pairs = make_pairs(n);
+  per_op meter(state);
+  for (auto _ : state) {
+    state.PauseTiming();
+    {
+      Map map(pairs);
+      meter.resume();
+      for (int k : keys) {
+        benchmark::DoNotOptimize(map.erase(k));
+      }
+      meter.pause(keys.size());
+    }
+    state.ResumeTiming();
+  }
+}
+
+template <typename Map>
+void iterate(benchmark::State& state) {
+  int n = state.range(0);
+  Map map(make_pairs(n));
+  per_op meter(state);
+  for (auto _ : state) {
+    state.PauseTiming();
+    meter.resume();
+    benchmark::DoNotOptimize(map.sum());
+    meter.pause(n);
+    state.ResumeTiming();
+  }
+}
+
+// Пул узлов общий на весь запуск: после больших вставок список свободных
+// узлов перемешан, и следующие замеры bimap ходят по разбросанной памяти.
+// Чтобы сравнивать числа между запусками, фильтруйте одинаково.
+// max_modify -- предел размера для вставок и удалений: у flat_bimap они
+// линейные, и на 1e7 случайных вставках замер не закончится
+template <typename Map>
+void register_map(std::string const& name, int max_modify = 10'000'000) {
+  for (pattern p : {SEQUENTIAL, RANDOM, ZIPF}) {
+    std::string suffix = std::string("/") + PATTERN_NAMES[p];
+    benchmark::RegisterBenchmark(("insert/" + name + suffix).c_str(),
+                                 insert<Map>, p)
+        ->RangeMultiplier(10)
+        ->Range(1000, max_modify);
+    benchmark::RegisterBenchmark(("find/" + name + suffix).c_str(), find<Map>,
+                                 p)
+        ->RangeMultiplier(10)
+        ->Range(1000, 10'000'000);
+    benchmark::RegisterBenchmark(("erase/" + name + suffix).c_str(),
+                                 erase<Map>, p)
+        ->RangeMultiplier(10)
+        ->Range(1000, max_modify);
+  }
+  benchmark::RegisterBenchmark(("iterate/" + name).c_str(), iterate<Map>)
+      ->RangeMultiplier(10)
+      ->Range(1000, 10'000'000);
+}
+
+// Многопоточная смесь чтений и записей
+constexpr int KEYS = 1 << 16;
+
+// тот же bimap под одним std::mutex: поиск splay-ит дерево, так что
+// даже читателям нужен монопольный замок
+struct locked_bimap {
+  std::mutex mut;
+  bimap<int, int> map;
+
+  bool insert(int left, int right) {
+    std::lock_guard lock(mut);
+    return map.insert(left, right) != map.end_left();
+  }
+  bool erase_left(int left) {
+    std::lock_guard lock(mut);
+    return map.erase_left(left);
+  }
+  bool contains_left(int left) {
+    std::lock_guard lock(mut);
+    return map.find_left(left) != map.end_left();
+  }
+};
+
+// state.range(0) -- доля записей в процентах; половина записей вставляет,
+// половина удаляет, так что размер держится около KEYS / 2
+template <typename Map>
+void concurrent_mix(benchmark::State& state) {
+  static Map* map;
+  if (state.thread_index() == 0) {
+    map = new Map();
+    for (int i = 0; i < KEYS; i += 2) {
+      map->insert(i, -i);
+    }
+  }
+  std::mt19937 e(state.thread_index());
+  unsigned writes = state.range(0);
+  for (auto _ : state) {
+    int key = e() % KEYS;
+    if (e() % 100 < writes) {
+      if (key % 2 == 0) {
+        map->insert(key, -key);
+      } else {
+        map->erase_left(key - 1);
+      }
+    } else {
+      benchmark::DoNotOptimize(map->contains_left(key));
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    delete map;
+  }
+}
+} // namespace
+
+BENCHMARK(concurrent_mix<concurrent_bimap<int, int>>)
+    ->ArgName("write%")
+    ->Arg(0)
+    ->Arg(10)
+    ->Arg(50)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK(concurrent_mix<locked_bimap>)
+    ->ArgName("write%")
+    ->Arg(0)
+    ->Arg(10)
+    ->Arg(50)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+int main(int argc, char** argv) {
+  register_map<bimap_adapter<bimap<int, int>>>("bimap");
+  register_map<bimap_adapter<pool_bimap<int, int>>>("pool_bimap");
+  register_map<bimap_adapter<flat_bimap<int, int>>>("flat_bimap", 100'000);
+  register_map<std_maps>("std_map_x2");
+#ifdef HAVE_BOOST_BIMAP
+  register_map<boost_bimap>("boost_bimap");
+#endif
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
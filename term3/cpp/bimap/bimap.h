@@ -1,20 +1,44 @@
 #pragma once
 
+#include "flat.h"
+#include "pool_allocator.h"
 #include "tree.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
-
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Allocator выделяет узлы (обе половины пары лежат в одном узле);
+// bimap_details::pool_allocator (pool_bimap ниже) берет их из пула слэбов
+// без обращения к куче на каждую вставку, но память пула системе до выхода
+// не возвращается, поэтому он не по умолчанию.
+// Policy выбирает устройство сторон: bimap_details::tree_policy -- два
+// splay-дерева на общих узлах, bimap_details::flat_policy -- отсортированные
+// массивы (flat.h, удобнее через flat_bimap ниже)
 template <typename Left, typename Right, typename CompareLeft = std::less<Left>,
-          typename CompareRight = std::less<Right>>
+          typename CompareRight = std::less<Right>,
+          typename Allocator = std::allocator<std::pair<Left, Right>>,
+          typename Policy = bimap_details::tree_policy>
 class bimap {
   using node_base = bimap_details::node_base;
   using node_l = bimap_details::node_base_value<Left, bimap_details::left_t>;
   using node_r = bimap_details::node_base_value<Right, bimap_details::right_t>;
   using map_l = bimap_details::map<Left, CompareLeft, bimap_details::left_t>;
   using map_r = bimap_details::map<Right, CompareRight, bimap_details::right_t>;
+  using node_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<bimap_details::node<Left, Right>>;
+  using alloc_traits = std::allocator_traits<node_allocator>;
 
   map_l l_map;
   map_r r_map;
   std::size_t _size = 0;
+  [[no_unique_address]] node_allocator alloc;
 
   template <typename NodeType1,
             typename NodeType2 = typename std::conditional_t<
@@ -33,6 +57,12 @@ class bimap {
     explicit template_iterator(node_base* node) : node(node) {}
 
   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = it_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = it_type const*;
+    using reference = it_type const&;
+
     // Элемент на который сейчас ссылается итератор.
     // Разыменование итератора end_left() неопределено.
     // Разыменование невалидного итератора неопределено.
@@ -99,30 +129,128 @@ public:
   using left_iterator = template_iterator<node_l>;
   using right_iterator = template_iterator<node_r>;
   using node_t = bimap_details::node<left_t, right_t>;
+  using allocator_type = Allocator;
+
+  // Пара, вынутая из bimap вместе со своим узлом. Пока handle не пуст, он
+  // владеет узлом; обе стороны можно менять, пара ни в каком дереве не лежит.
+  // Вставка в bimap с равным аллокатором не делает ни одной аллокации.
+  class node_type {
+    friend class bimap;
+
+    node_t* node = nullptr;
+    std::optional<node_allocator> alloc;
+
+    node_type(node_t* node, node_allocator const& alloc)
+        : node(node), alloc(alloc) {}
+
+    node_t* release() noexcept {
+      alloc.reset();
+      return std::exchange(node, nullptr);
+    }
+
+    void reset() noexcept {
+      if (node != nullptr) {
+        // не через release(): аргументы вычисляются в любом порядке, и
+        // аллокатор мог бы исчезнуть раньше, чем его разыменуют
+        destroy_node(*alloc, node);
+        node = nullptr;
+        alloc.reset();
+      }
+    }
+
+  public:
+    node_type() noexcept = default;
+    node_type(node_type&& other) noexcept
+        : node(other.node), alloc(std::move(other.alloc)) {
+      other.release();
+    }
+    node_type& operator=(node_type&& other) noexcept {
+      if (this != &other) {
+        reset();
+        node = other.node;
+        alloc = std::move(other.alloc);
+        other.release();
+      }
+      return *this;
+    }
+    ~node_type() {
+      reset();
+    }
+
+    bool empty() const noexcept {
+      return node == nullptr;
+    }
+    explicit operator bool() const noexcept {
+      return node != nullptr;
+    }
+
+    // Обращение к сторонам пустого handle неопределено.
+    left_t& left() const noexcept {
+      return static_cast<node_l*>(node)->val1;
+    }
+    right_t& right() const noexcept {
+      return static_cast<node_r*>(node)->val1;
+    }
+
+    allocator_type get_allocator() const {
+      return allocator_type(*alloc);
+    }
+
+    void swap(node_type& other) noexcept {
+      std::swap(node, other.node);
+      std::swap(alloc, other.alloc);
+    }
+  };
 
   // Создает bimap не содержащий ни одной пары.
   bimap(CompareLeft compare_left = CompareLeft(),
-        CompareRight compare_right = CompareRight())
-      : l_map(std::move(compare_left)), r_map(std::move(compare_right)) {
+        CompareRight compare_right = CompareRight(),
+        Allocator const& allocator = Allocator())
+      : l_map(std::move(compare_left)), r_map(std::move(compare_right)),
+        alloc(allocator) {
     l_map.end_node.r = &r_map.end_node;
     r_map.end_node.r = &l_map.end_node;
   }
 
+  // Создает bimap из пар [first, last) (std::pair, std::tuple и т.п.).
+  // Пары, чей left или right уже встречался раньше в диапазоне, отбрасываются
+  // -- ровно как при вставке по одной в том же порядке. Деревья собираются
+  // сразу сбалансированными: O(n log n) сравнений на сортировку и O(n) на
+  // сборку, без единого поворота.
+  template <std::input_iterator InputIt>
+  bimap(InputIt first, InputIt last, CompareLeft compare_left = CompareLeft(),
+        CompareRight compare_right = CompareRight(),
+        Allocator const& allocator = Allocator())
+      : bimap(std::move(compare_left), std::move(compare_right), allocator) {
+    assign_range(first, last, false);
+  }
+
+  // То же для диапазона, уже отсортированного по left: левая сторона не
+  // сортируется, только правая. Если диапазон на деле не отсортирован,
+  // результат такой же, как у конструктора от диапазона.
+  template <std::ranges::input_range Range>
+  static bimap from_sorted(Range&& range,
+                           CompareLeft compare_left = CompareLeft(),
+                           CompareRight compare_right = CompareRight(),
+                           Allocator const& allocator = Allocator()) {
+    bimap res(std::move(compare_left), std::move(compare_right), allocator);
+    res.assign_range(std::ranges::begin(range), std::ranges::end(range), true);
+    return res;
+  }
+
   // Конструкторы от других и присваивания
+  // Копирование линейное: обход обоих деревьев по порядку и сборка заново
   bimap(bimap const& other)
-      : l_map(other.l_map.getComparator()), r_map(other.r_map.getComparator()) {
+      : l_map(other.l_map.getComparator()), r_map(other.r_map.getComparator()),
+        alloc(alloc_traits::select_on_container_copy_construction(
+            other.alloc)) {
     l_map.end_node.r = &r_map.end_node;
     r_map.end_node.r = &l_map.end_node;
-    try {
-      for (auto i = other.begin_left(); i != other.end_left(); i++) {
-        insert(*i, *i.flip());
-      }
-    } catch (...) {
-      erase_left(begin_left(), end_left());
-      throw;
-    }
+    copy_from(other);
+    // copy_from собирает сбалансированные деревья, так что достаточно флага
+    l_map.frozen = r_map.frozen = other.frozen();
   }
-  bimap(bimap&& other) noexcept {
+  bimap(bimap&& other) noexcept : alloc(other.alloc) {
     l_map.end_node.r = &r_map.end_node;
     r_map.end_node.r = &l_map.end_node;
     swap(other);
@@ -149,7 +277,7 @@ public:
   // Инвалидирует все итераторы ссылающиеся на элементы этого bimap
   // (включая итераторы ссылающиеся на элементы следующие за последними).
   ~bimap() {
-    erase_left(begin_left(), end_left());
+    clear();
   }
 
   // Вставка пары (left, right), возвращает итератор на left.
@@ -168,6 +296,35 @@ public:
     return map_insert(std::move(left), std::move(right));
   }
 
+  // Вставка пары из handle, возвращает итератор на left.
+  // Если handle пуст или такой left или right уже есть, вставка не
+  // производится, handle остается нетронутым и возвращается end_left().
+  // Вставка handle из bimap с неравным аллокатором неопределена.
+  left_iterator insert(node_type&& handle) {
+    if (handle.empty() || find_left(handle.left()) != end_left() ||
+        find_right(handle.right()) != end_right()) {
+      return end_left();
+    }
+    return link(handle.release());
+  }
+
+  // Вынимает пару из bimap, не освобождая узел.
+  // extract(end_left()) и extract(end_right()) неопределены.
+  // Инвалидирует итераторы на вынутую пару.
+  node_type extract_left(left_iterator it) {
+    return node_type(unlink(it), alloc);
+  }
+  node_type extract_right(right_iterator it) {
+    return node_type(unlink(it), alloc);
+  }
+  // По ключу: если его нет, возвращается пустой handle
+  node_type extract_left(left_t const& left) {
+    return extract_found(find_left(left), end_left());
+  }
+  node_type extract_right(right_t const& right) {
+    return extract_found(find_right(right), end_right());
+  }
+
   // Удаляет элемент и соответствующий ему парный.
   // erase невалидного итератора неопределен.
   // erase(end_left()) и erase(end_right()) неопределены.
@@ -179,22 +336,14 @@ public:
   // Аналогично erase, но по ключу, удаляет элемент если он присутствует, иначе
   // не делает ничего Возвращает была ли пара удалена
   bool erase_left(left_t const& left) {
-    left_iterator it = find_left(left);
-    if (it == end_left())
-      return false;
-    erase_left(it);
-    return true;
+    return erase_found(find_left(left), end_left());
   }
 
   right_iterator erase_right(right_iterator it) {
     return map_erase(it);
   }
   bool erase_right(right_t const& right) {
-    right_iterator it = find_right(right);
-    if (it == end_right())
-      return false;
-    erase_right(it);
-    return true;
+    return erase_found(find_right(right), end_right());
   }
 
   // erase от ренжа, удаляет [first, last), возвращает итератор на последний
@@ -206,6 +355,16 @@ public:
     return map_erase(first, last);
   }
 
+  // Удаляет все пары за линейное время, без перестроек деревьев
+  void clear() noexcept {
+    map_l::dismantle(l_map.end_node.l, [this](bimap_details::node_base* n) {
+      destroy_node(alloc, static_cast<node_t*>(static_cast<node_l*>(n)));
+    });
+    l_map.reset();
+    r_map.reset();
+    _size = 0;
+  }
+
   // Возвращает итератор по элементу. Если не найден - соответствующий
   // rightmost()
   left_iterator find_left(left_t const& left) const noexcept {
@@ -218,18 +377,10 @@ public:
   // Возвращает противоположный элемент по элементу
   // Если элемента не существует -- бросает std::out_of_range
   right_t const& at_left(left_t const& key) const {
-    right_iterator node = find_left(key).flip();
-    if (node == end_right()) {
-      throw std::out_of_range("Out of range");
-    }
-    return *node;
+    return paired(find_left(key), end_left());
   }
   left_t const& at_right(right_t const& key) const {
-    left_iterator node = find_right(key).flip();
-    if (node == end_left()) {
-      throw std::out_of_range("Out of range");
-    }
-    return *node;
+    return paired(find_right(key), end_right());
   }
 
   // Возвращает противоположный элемент по элементу
@@ -268,14 +419,66 @@ public:
     return left_iterator(l_map.lower(left));
   }
   left_iterator upper_bound_left(const left_t& left) const {
-    return left_iterator(l_map.lower(left));
+    return left_iterator(l_map.upper(left));
   }
 
   right_iterator lower_bound_right(const right_t& left) const {
     return right_iterator(r_map.lower(left));
   }
   right_iterator upper_bound_right(const right_t& left) const {
-    return right_iterator(r_map.lower(left));
+    return right_iterator(r_map.upper(left));
+  }
+
+  // Поиск по значениям другого типа, если компаратор стороны прозрачный
+  // (CompareLeft::is_transparent, как у std::less<>): ключ не создается.
+  // Те же правила, что у одноименных методов выше.
+  template <bimap_details::transparent_key<CompareLeft, left_iterator> K>
+  left_iterator find_left(K const& left) const {
+    return left_iterator(l_map.find(left));
+  }
+  template <bimap_details::transparent_key<CompareRight, right_iterator> K>
+  right_iterator find_right(K const& right) const {
+    return right_iterator(r_map.find(right));
+  }
+  template <bimap_details::transparent_key<CompareLeft, left_iterator> K>
+  right_t const& at_left(K const& key) const {
+    return paired(find_left(key), end_left());
+  }
+  template <bimap_details::transparent_key<CompareRight, right_iterator> K>
+  left_t const& at_right(K const& key) const {
+    return paired(find_right(key), end_right());
+  }
+  template <bimap_details::transparent_key<CompareLeft, left_iterator> K>
+  bool erase_left(K const& left) {
+    return erase_found(find_left(left), end_left());
+  }
+  template <bimap_details::transparent_key<CompareRight, right_iterator> K>
+  bool erase_right(K const& right) {
+    return erase_found(find_right(right), end_right());
+  }
+  template <bimap_details::transparent_key<CompareLeft, left_iterator> K>
+  node_type extract_left(K const& left) {
+    return extract_found(find_left(left), end_left());
+  }
+  template <bimap_details::transparent_key<CompareRight, right_iterator> K>
+  node_type extract_right(K const& right) {
+    return extract_found(find_right(right), end_right());
+  }
+  template <bimap_details::transparent_key<CompareLeft, left_iterator> K>
+  left_iterator lower_bound_left(K const& left) const {
+    return left_iterator(l_map.lower(left));
+  }
+  template <bimap_details::transparent_key<CompareLeft, left_iterator> K>
+  left_iterator upper_bound_left(K const& left) const {
+    return left_iterator(l_map.upper(left));
+  }
+  template <bimap_details::transparent_key<CompareRight, right_iterator> K>
+  right_iterator lower_bound_right(K const& right) const {
+    return right_iterator(r_map.lower(right));
+  }
+  template <bimap_details::transparent_key<CompareRight, right_iterator> K>
+  right_iterator upper_bound_right(K const& right) const {
+    return right_iterator(r_map.upper(right));
   }
 
   // Возващает итератор на минимальный по порядку left.
@@ -306,6 +509,32 @@ public:
     return _size;
   }
 
+  // Поиск перестраивает деревья, поэтому даже константные find/at/bound
+  // нельзя звать параллельно. freeze() балансирует оба дерева и отключает
+  // перестройку при поиске: пока bimap заморожен, константные методы можно
+  // звать из многих потоков сразу. Вставки и удаления по-прежнему требуют
+  // монопольного доступа; в замороженном bimap они не splay-ят, а держат
+  // глубину деревьев O(log n) перестройкой поддеревьев (scapegoat).
+  // Заморозка переезжает вместе с содержимым при swap и перемещении и
+  // сохраняется в копии.
+  void freeze() {
+    bool was_frozen = l_map.frozen;
+    l_map.freeze();
+    try {
+      r_map.freeze();
+    } catch (...) {
+      l_map.frozen = was_frozen;
+      throw;
+    }
+  }
+  void unfreeze() noexcept {
+    l_map.unfreeze();
+    r_map.unfreeze();
+  }
+  bool frozen() const noexcept {
+    return l_map.frozen;
+  }
+
   // операторы сравнения
   friend bool operator==(bimap const& a, bimap const& b) {
     if (a.size() != b.size()) {
@@ -332,44 +561,287 @@ public:
     l_map.swap(map.l_map);
     r_map.swap(map.r_map);
     std::swap(_size, map._size);
+    if constexpr (alloc_traits::propagate_on_container_swap::value) {
+      std::swap(alloc, map.alloc);
+    }
+  }
+
+  allocator_type get_allocator() const {
+    return allocator_type(alloc);
   }
 
 private:
   template <typename T1, typename T2>
   left_iterator map_insert(T1&& left, T2&& right) {
     if (find_left(left) == end_left() && find_right(right) == end_right()) {
-      node_t* new_node =
-          new node_t(std::forward<T1>(left), std::forward<T2>(right));
-      l_map.insert(static_cast<node_l*>(new_node));
-      r_map.insert(static_cast<node_r*>(new_node));
-      _size++;
-      return left_iterator(static_cast<node_l*>(new_node));
+      return link(create_node(std::forward<T1>(left), std::forward<T2>(right)));
     }
     return end_left();
   }
 
+  template <typename T1, typename T2>
+  node_t* create_node(T1&& left, T2&& right) {
+    node_t* node = alloc_traits::allocate(alloc, 1);
+    try {
+      alloc_traits::construct(alloc, node, std::forward<T1>(left),
+                              std::forward<T2>(right));
+    } catch (...) {
+      alloc_traits::deallocate(alloc, node, 1);
+      throw;
+    }
+    return node;
+  }
+
+  static left_t const& left_of(node_t const* node) noexcept {
+    return static_cast<node_l const*>(node)->val1;
+  }
+  static right_t const& right_of(node_t const* node) noexcept {
+    return static_cast<node_r const*>(node)->val1;
+  }
+
+  // вешает на пустой bimap узлы, уже упорядоченные по каждой стороне
+  void adopt(std::vector<node_base*>& lefts,
+             std::vector<node_base*>& rights) noexcept {
+    l_map.assign(lefts);
+    r_map.assign(rights);
+    _size = lefts.size();
+  }
+
+  template <typename InputIt, typename Sentinel>
+  void assign_range(InputIt first, Sentinel last, bool left_sorted) {
+    std::vector<node_t*> nodes;
+    if constexpr (std::forward_iterator<InputIt>) {
+      nodes.reserve(std::ranges::distance(first, last));
+    }
+    try {
+      for (; first != last; ++first) {
+        auto&& pair = *first;
+        nodes.push_back(nullptr);
+        nodes.back() =
+            create_node(std::get<0>(std::forward<decltype(pair)>(pair)),
+                        std::get<1>(std::forward<decltype(pair)>(pair)));
+      }
+      auto [by_left, by_right] = bimap_details::sorted_unique(
+          nodes.size(),
+          [&](std::size_t a, std::size_t b) {
+            return l_map.larger(left_of(nodes[a]), left_of(nodes[b]));
+          },
+          [&](std::size_t a, std::size_t b) {
+            return r_map.larger(right_of(nodes[a]), right_of(nodes[b]));
+          },
+          left_sorted);
+
+      std::vector<node_base*> lefts(by_left.size()), rights(by_right.size());
+      for (std::size_t k = 0; k < by_left.size(); k++) {
+        lefts[k] = static_cast<node_l*>(nodes[by_left[k]]);
+        rights[k] = static_cast<node_r*>(nodes[by_right[k]]);
+      }
+      for (std::size_t i : by_left) {
+        nodes[i] = nullptr;
+      }
+      adopt(lefts, rights);
+    } catch (...) {
+      for (node_t* node : nodes) {
+        if (node != nullptr) {
+          destroy_node(alloc, node);
+        }
+      }
+      throw;
+    }
+    // остались только отброшенные дубликаты
+    for (node_t* node : nodes) {
+      if (node != nullptr) {
+        destroy_node(alloc, node);
+      }
+    }
+  }
+
+  // копии создаются в левом порядке; чтобы расставить их в правом, нужно
+  // соответствие старых узлов новым -- таблица с открытой адресацией по
+  // адресу старого узла, так что копирование линейное
+  void copy_from(bimap const& other) {
+    std::size_t n = other._size;
+    std::size_t mask = std::bit_ceil(n + n / 2 + 1) - 1;
+    std::vector<std::pair<node_t const*, node_t*>> index(mask + 1);
+    auto slot = [&](node_t const* old) {
+      auto h = reinterpret_cast<std::uintptr_t>(old) * 0x9E3779B97F4A7C15ull;
+      std::size_t i = (h >> 32) & mask;
+      while (index[i].first != nullptr && index[i].first != old) {
+        i = (i + 1) & mask;
+      }
+      return i;
+    };
+    std::vector<node_base*> lefts, rights;
+    lefts.reserve(n);
+    rights.reserve(n);
+    try {
+      for (auto it = other.begin_left(); it != other.end_left(); it++) {
+        node_t const* old = to_node(it);
+        node_t* copy = create_node(left_of(old), right_of(old));
+        lefts.push_back(static_cast<node_l*>(copy));
+        index[slot(old)] = {old, copy};
+      }
+    } catch (...) {
+      for (node_base* node : lefts) {
+        destroy_node(alloc, static_cast<node_t*>(static_cast<node_l*>(node)));
+      }
+      throw;
+    }
+    for (auto it = other.begin_right(); it != other.end_right(); it++) {
+      rights.push_back(static_cast<node_r*>(index[slot(to_node(it))].second));
+    }
+    adopt(lefts, rights);
+  }
+
   template <typename T>
-  T map_erase(T it) {
-    T ret(it.node);
-    ret++;
-    node_t* node;
+  static node_t* to_node(T it) noexcept {
     if constexpr (std::is_same_v<T, left_iterator>) {
-      node = static_cast<node_t*>(static_cast<node_l*>(it.node));
+      return static_cast<node_t*>(static_cast<node_l*>(it.node));
     } else {
-      node = static_cast<node_t*>(static_cast<node_r*>(it.node));
+      return static_cast<node_t*>(static_cast<node_r*>(it.node));
     }
+  }
+
+  left_iterator link(node_t* node) noexcept {
+    l_map.insert(static_cast<node_l*>(node));
+    r_map.insert(static_cast<node_r*>(node));
+    _size++;
+    return left_iterator(static_cast<node_l*>(node));
+  }
+
+  template <typename T>
+  node_t* unlink(T it) noexcept {
+    node_t* node = to_node(it);
     l_map.erase(static_cast<node_l*>(node));
     r_map.erase(static_cast<node_r*>(node));
     _size--;
-    delete node;
+    return node;
+  }
+
+  static void destroy_node(node_allocator& alloc, node_t* node) noexcept {
+    alloc_traits::destroy(alloc, node);
+    alloc_traits::deallocate(alloc, node, 1);
+  }
+
+  // значение, парное найденному, или std::out_of_range
+  template <typename T>
+  static auto const& paired(T it, T end) {
+    if (it == end) {
+      throw std::out_of_range("Out of range");
+    }
+    return *it.flip();
+  }
+
+  template <typename T>
+  bool erase_found(T it, T end) {
+    if (it == end) {
+      return false;
+    }
+    map_erase(it);
+    return true;
+  }
+
+  template <typename T>
+  node_type extract_found(T it, T end) {
+    if (it == end) {
+      return node_type();
+    }
+    return node_type(unlink(it), alloc);
+  }
+
+  template <typename T>
+  T map_erase(T it) {
+    T ret(it.node);
+    ret++;
+    destroy_node(alloc, unlink(it));
     return ret;
   }
 
+  // узел той стороны, что парная к стороне итератора T
+  template <typename T>
+  static bimap_details::node_base* other_side(node_t* node) noexcept {
+    if constexpr (std::is_same_v<T, left_iterator>) {
+      return static_cast<node_r*>(node);
+    } else {
+      return static_cast<node_l*>(node);
+    }
+  }
+
+  // Весь диапазон -- это clear(). Иначе в дереве своей стороны [left, right)
+  // вырезается одним поддеревом, а из парного дерева k вырезанных пар
+  // удаляются по одной, если k * log n < n, или одним линейным проходом.
+  // Замороженное дерево не splay-ится, там удаление всегда поштучное.
   template <typename T>
   T map_erase(T left, T right) {
-    for (; left != right;) {
-      left = map_erase(left);
+    using flip_t = decltype(left.flip());
+    constexpr bool by_left = std::is_same_v<T, left_iterator>;
+    auto& own = [this]() -> auto& {
+      if constexpr (by_left) {
+        return l_map;
+      } else {
+        return r_map;
+      }
+    }();
+    auto& other = [this]() -> auto& {
+      if constexpr (by_left) {
+        return r_map;
+      } else {
+        return l_map;
+      }
+    }();
+
+    if (left == right) {
+      return right;
+    }
+    if (left.node == own.begin() && right.node == own.end()) {
+      clear();
+      return right;
+    }
+    if (own.frozen) {
+      while (left != right) {
+        left = map_erase(left);
+      }
+      return right;
     }
-    return left;
+    std::size_t total = _size, removed = 0;
+    bimap_details::node_base* list = nullptr;
+    own.cut(left.node, right.node, [&](bimap_details::node_base* n) {
+      // в дереве у каждого узла есть родитель, так вырезанные и отличаются
+      n->p = nullptr;
+      n->r = list;
+      list = n;
+      removed++;
+    });
+    _size -= removed;
+    if (removed * std::bit_width(total) < total) {
+      while (list != nullptr) {
+        node_t* node = to_node(T(list));
+        list = list->r;
+        other.erase(other_side<T>(node));
+        destroy_node(alloc, node);
+      }
+    } else {
+      other.filter([this](bimap_details::node_base* n) {
+        node_t* node = to_node(flip_t(n));
+        if (other_side<flip_t>(node)->p != nullptr) {
+          return true;
+        }
+        destroy_node(alloc, node);
+        return false;
+      });
+    }
+    return right;
   }
 };
+
+template <typename Left, typename Right, typename CompareLeft = std::less<Left>,
+          typename CompareRight = std::less<Right>>
+using flat_bimap =
+    bimap<Left, Right, CompareLeft, CompareRight,
+          std::allocator<std::pair<Left, Right>>, bimap_details::flat_policy>;
+
+template <typename Left, typename Right, typename CompareLeft = std::less<Left>,
+          typename CompareRight = std::less<Right>>
+using pool_bimap =
+    bimap<Left, Right, CompareLeft, CompareRight,
+          bimap_details::pool_allocator<std::pair<Left, Right>>>;
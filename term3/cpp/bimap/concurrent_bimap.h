@@ -0,0 +1,187 @@
+#pragma once
+
+#include "bimap.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+
+namespace bimap_details {
+// читатели-писатели с приоритетом писателя: std::shared_mutex в glibc
+// пускает новых читателей, пока очередь читателей не опустеет, и под
+// постоянным чтением писатель может не дождаться замка никогда
+class rw_lock {
+  static constexpr std::uint32_t WRITER = 1u << 31;
+
+  // число читателей внутри и бит WRITER, пока писатель ждет или работает
+  std::atomic<std::uint32_t> state = 0;
+  // писатели проходят по одному
+  std::mutex writers;
+
+public:
+  void lock() {
+    writers.lock();
+    std::uint32_t cur = state.fetch_or(WRITER, std::memory_order_acquire);
+    cur |= WRITER;
+    while (cur != WRITER) {
+      state.wait(cur, std::memory_order_acquire);
+      cur = state.load(std::memory_order_acquire);
+    }
+  }
+  void unlock() {
+    state.fetch_and(~WRITER, std::memory_order_release);
+    state.notify_all();
+    writers.unlock();
+  }
+
+  void lock_shared() {
+    std::uint32_t cur = state.load(std::memory_order_relaxed);
+    while (true) {
+      if (cur & WRITER) {
+        state.wait(cur, std::memory_order_relaxed);
+        cur = state.load(std::memory_order_relaxed);
+      } else if (state.compare_exchange_weak(cur, cur + 1,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+        return;
+      }
+    }
+  }
+  void unlock_shared() {
+    // последний читатель будит ждущего писателя
+    if (state.fetch_sub(1, std::memory_order_release) == WRITER + 1) {
+      state.notify_all();
+    }
+  }
+};
+} // namespace bimap_details
+
+// bimap для многих потоков. Внутренний bimap все время заморожен: поиск по
+// нему ничего не пишет, поэтому читатели работают параллельно под общим
+// замком, а писатель берет его монопольно (и новых читателей не пускает).
+// Изменения замороженного дерева не splay-ят, а держат его сбалансированным.
+// Итераторы наружу не выдаются (после снятия замка пара могла бы исчезнуть),
+// поиск возвращает копии значений.
+template <typename Left, typename Right, typename CompareLeft = std::less<Left>,
+          typename CompareRight = std::less<Right>,
+          typename Allocator = std::allocator<std::pair<Left, Right>>,
+          typename Policy = bimap_details::tree_policy>
+class concurrent_bimap {
+public:
+  using map_t = bimap<Left, Right, CompareLeft, CompareRight, Allocator, Policy>;
+  using left_t = Left;
+  using right_t = Right;
+
+private:
+  mutable bimap_details::rw_lock mut;
+  map_t map;
+
+public:
+  concurrent_bimap(CompareLeft compare_left = CompareLeft(),
+                   CompareRight compare_right = CompareRight(),
+                   Allocator const& allocator = Allocator())
+      : map(std::move(compare_left), std::move(compare_right), allocator) {
+    map.freeze();
+  }
+  explicit concurrent_bimap(map_t other) : map(std::move(other)) {
+    map.freeze();
+  }
+
+  concurrent_bimap(concurrent_bimap const&) = delete;
+  concurrent_bimap& operator=(concurrent_bimap const&) = delete;
+
+  // Вставка пары, false если такой left или right уже есть
+  template <typename L, typename R>
+  bool insert(L&& left, R&& right) {
+    std::unique_lock lock(mut);
+    return map.insert(std::forward<L>(left), std::forward<R>(right)) !=
+           map.end_left();
+  }
+
+  template <typename K>
+  bool erase_left(K const& left) {
+    std::unique_lock lock(mut);
+    return map.erase_left(left);
+  }
+  template <typename K>
+  bool erase_right(K const& right) {
+    std::unique_lock lock(mut);
+    return map.erase_right(right);
+  }
+
+  // Парное значение или nullopt, если ключа нет
+  template <typename K>
+  std::optional<Right> find_left(K const& left) const {
+    std::shared_lock lock(mut);
+    auto it = map.find_left(left);
+    if (it == map.end_left()) {
+      return std::nullopt;
+    }
+    return *it.flip();
+  }
+  template <typename K>
+  std::optional<Left> find_right(K const& right) const {
+    std::shared_lock lock(mut);
+    auto it = map.find_right(right);
+    if (it == map.end_right()) {
+      return std::nullopt;
+    }
+    return *it.flip();
+  }
+
+  // Как у bimap: если ключа нет -- std::out_of_range
+  template <typename K>
+  Right at_left(K const& left) const {
+    std::shared_lock lock(mut);
+    return map.at_left(left);
+  }
+  template <typename K>
+  Left at_right(K const& right) const {
+    std::shared_lock lock(mut);
+    return map.at_right(right);
+  }
+
+  template <typename K>
+  bool contains_left(K const& left) const {
+    std::shared_lock lock(mut);
+    return map.find_left(left) != map.end_left();
+  }
+  template <typename K>
+  bool contains_right(K const& right) const {
+    std::shared_lock lock(mut);
+    return map.find_right(right) != map.end_right();
+  }
+
+  std::size_t size() const {
+    std::shared_lock lock(mut);
+    return map.size();
+  }
+  bool empty() const {
+    std::shared_lock lock(mut);
+    return map.empty();
+  }
+
+  // Обход и прочие составные чтения: f получает bimap const& под общим
+  // замком. Итераторы и ссылки не должны пережить вызов.
+  template <typename F>
+  decltype(auto) read(F&& f) const {
+    std::shared_lock lock(mut);
+    return std::forward<F>(f)(std::as_const(map));
+  }
+  // Составные изменения под монопольным замком. f не должна звать
+  // unfreeze() или присваивать незамороженный bimap: после снятия замка
+  // читатели рассчитывают на заморозку.
+  template <typename F>
+  decltype(auto) write(F&& f) {
+    std::unique_lock lock(mut);
+    return std::forward<F>(f)(map);
+  }
+
+  // Копия содержимого на момент вызова
+  map_t snapshot() const {
+    std::shared_lock lock(mut);
+    return map;
+  }
+};
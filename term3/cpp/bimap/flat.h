@@ -0,0 +1,651 @@
+#pragma once
+
+#include "tree.h"
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// bimap на отсортированных массивах: ключи каждой стороны лежат подряд по
+// порядку, а для каждого ключа хранится позиция его пары на другой стороне.
+// Поиск -- двоичный по непрерывному массиву, flip -- одно чтение, обход --
+// линейный проход по памяти; зато вставка и удаление сдвигают массивы за O(n).
+// Итераторы устроены как позиции, поэтому любая вставка или удаление
+// инвалидирует все итераторы, кроме end, как у std::vector. Поиск ничего не
+// меняет, константные методы можно звать из многих потоков без freeze().
+template <typename Left, typename Right, typename CompareLeft,
+          typename CompareRight, typename Allocator>
+class bimap<Left, Right, CompareLeft, CompareRight, Allocator,
+            bimap_details::flat_policy> {
+  template <typename T>
+  using rebind =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+  using positions = std::vector<std::size_t, rebind<std::size_t>>;
+
+  std::vector<Left, rebind<Left>> lefts;
+  std::vector<Right, rebind<Right>> rights;
+  // l_partner[i] -- позиция в rights пары lefts[i], r_partner -- наоборот
+  positions l_partner;
+  positions r_partner;
+  [[no_unique_address]] CompareLeft cmp_left;
+  [[no_unique_address]] CompareRight cmp_right;
+
+  // позиция end: не зависит от размера, так что end переживает вставки
+  static constexpr std::size_t END = -1;
+
+  template <bool IsLeft>
+  class template_iterator {
+    bimap const* owner;
+    std::size_t pos;
+    friend class bimap;
+    template <bool>
+    friend class template_iterator;
+    using it_type = std::conditional_t<IsLeft, Left, Right>;
+    using flip_iterator = template_iterator<!IsLeft>;
+
+    template_iterator(bimap const* owner, std::size_t pos)
+        : owner(owner), pos(pos == owner->size() ? END : pos) {}
+
+    std::size_t index() const noexcept {
+      return pos == END ? owner->size() : pos;
+    }
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = it_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = it_type const*;
+    using reference = it_type const&;
+
+    // Разыменование end и невалидного итератора неопределено.
+    it_type const& operator*() const noexcept {
+      if constexpr (IsLeft) {
+        return owner->lefts[pos];
+      } else {
+        return owner->rights[pos];
+      }
+    }
+    it_type const* operator->() const noexcept {
+      return &**this;
+    }
+
+    template_iterator& operator++() noexcept {
+      pos = pos + 1 == owner->size() ? END : pos + 1;
+      return *this;
+    }
+    template_iterator operator++(int) noexcept {
+      auto old_it = *this;
+      ++(*this);
+      return old_it;
+    }
+
+    template_iterator& operator--() noexcept {
+      pos = index() - 1;
+      return *this;
+    }
+    template_iterator operator--(int) noexcept {
+      auto old_it = *this;
+      --(*this);
+      return old_it;
+    }
+
+    // Как у дерева: end одной стороны переходит в end другой.
+    flip_iterator flip() const noexcept {
+      if (pos == END) {
+        return flip_iterator(owner, END);
+      }
+      if constexpr (IsLeft) {
+        return flip_iterator(owner, owner->l_partner[pos]);
+      } else {
+        return flip_iterator(owner, owner->r_partner[pos]);
+      }
+    }
+
+    friend bool operator==(const template_iterator& a,
+                           const template_iterator& b) {
+      return a.pos == b.pos;
+    }
+    friend bool operator!=(const template_iterator& a,
+                           const template_iterator& b) {
+      return a.pos != b.pos;
+    }
+  };
+
+public:
+  using left_t = Left;
+  using right_t = Right;
+  using left_iterator = template_iterator<true>;
+  using right_iterator = template_iterator<false>;
+  using allocator_type = Allocator;
+
+  // Пара, вынутая из bimap. Узлов здесь нет, так что handle просто хранит
+  // саму пару, вставка обратно все равно сдвигает массивы.
+  class node_type {
+    friend class bimap;
+
+    mutable std::optional<std::pair<left_t, right_t>> value;
+    std::optional<allocator_type> alloc;
+
+    node_type(left_t&& left, right_t&& right, allocator_type const& alloc)
+        : value(std::in_place, std::move(left), std::move(right)),
+          alloc(alloc) {}
+
+  public:
+    node_type() noexcept = default;
+    node_type(node_type&& other) noexcept
+        : value(std::move(other.value)), alloc(std::move(other.alloc)) {
+      other.value.reset();
+      other.alloc.reset();
+    }
+    node_type& operator=(node_type&& other) noexcept {
+      if (this != &other) {
+        value = std::move(other.value);
+        alloc = std::move(other.alloc);
+        other.value.reset();
+        other.alloc.reset();
+      }
+      return *this;
+    }
+
+    bool empty() const noexcept {
+      return !value.has_value();
+    }
+    explicit operator bool() const noexcept {
+      return value.has_value();
+    }
+
+    left_t& left() const noexcept {
+      return value->first;
+    }
+    right_t& right() const noexcept {
+      return value->second;
+    }
+
+    allocator_type get_allocator() const {
+      return *alloc;
+    }
+
+    void swap(node_type& other) noexcept {
+      std::swap(value, other.value);
+      std::swap(alloc, other.alloc);
+    }
+  };
+
+  bimap(CompareLeft compare_left = CompareLeft(),
+        CompareRight compare_right = CompareRight(),
+        Allocator const& allocator = Allocator())
+      : lefts(allocator), rights(allocator), l_partner(allocator),
+        r_partner(allocator), cmp_left(std::move(compare_left)),
+        cmp_right(std::move(compare_right)) {}
+
+  template <std::input_iterator InputIt>
+  bimap(InputIt first, InputIt last, CompareLeft compare_left = CompareLeft(),
+        CompareRight compare_right = CompareRight(),
+        Allocator const& allocator = Allocator())
+      : bimap(std::move(compare_left), std::move(compare_right), allocator) {
+    assign_range(first, last, false);
+  }
+
+  template <std::ranges::input_range Range>
+  static bimap from_sorted(Range&& range,
+                           CompareLeft compare_left = CompareLeft(),
+                           CompareRight compare_right = CompareRight(),
+                           Allocator const& allocator = Allocator()) {
+    bimap res(std::move(compare_left), std::move(compare_right), allocator);
+    res.assign_range(std::ranges::begin(range), std::ranges::end(range), true);
+    return res;
+  }
+
+  bimap(bimap const& other) = default;
+  bimap(bimap&& other) noexcept = default;
+
+  bimap& operator=(bimap const& other) {
+    if (this == &other) {
+      return *this;
+    }
+    bimap map(other);
+    swap(map);
+    return *this;
+  }
+  bimap& operator=(bimap&& other) noexcept {
+    if (this == &other) {
+      return *this;
+    }
+    bimap map(std::move(other));
+    swap(map);
+    return *this;
+  }
+
+  ~bimap() = default;
+
+  left_iterator insert(left_t const& left, right_t const& right) {
+    return map_insert(left, right);
+  }
+  left_iterator insert(left_t const& left, right_t&& right) {
+    return map_insert(left, std::move(right));
+  }
+  left_iterator insert(left_t&& left, right_t const& right) {
+    return map_insert(std::move(left), right);
+  }
+  left_iterator insert(left_t&& left, right_t&& right) {
+    return map_insert(std::move(left), std::move(right));
+  }
+
+  // Если handle пуст или такой left или right уже есть, handle остается
+  // нетронутым и возвращается end_left().
+  left_iterator insert(node_type&& handle) {
+    if (handle.empty()) {
+      return end_left();
+    }
+    left_iterator it = map_insert(std::move(handle.left()),
+                                  std::move(handle.right()));
+    if (it != end_left()) {
+      handle = node_type();
+    }
+    return it;
+  }
+
+  node_type extract_left(left_iterator it) {
+    std::size_t pl = it.pos;
+    std::size_t pr = l_partner[pl];
+    node_type res(std::move(lefts[pl]), std::move(rights[pr]),
+                  get_allocator());
+    erase_pair(pl, pr);
+    return res;
+  }
+  node_type extract_right(right_iterator it) {
+    return extract_left(it.flip());
+  }
+  node_type extract_left(left_t const& left) {
+    return extract_found(find_left(left), end_left());
+  }
+  node_type extract_right(right_t const& right) {
+    return extract_found(find_right(right), end_right());
+  }
+
+  // Возвращает итератор на следующий элемент той же стороны
+  left_iterator erase_left(left_iterator it) {
+    erase_pair(it.pos, l_partner[it.pos]);
+    return left_iterator(this, it.pos);
+  }
+  bool erase_left(left_t const& left) {
+    return erase_found(find_left(left), end_left());
+  }
+
+  right_iterator erase_right(right_iterator it) {
+    erase_pair(r_partner[it.pos], it.pos);
+    return right_iterator(this, it.pos);
+  }
+  bool erase_right(right_t const& right) {
+    return erase_found(find_right(right), end_right());
+  }
+
+  // Удаление [first, last) за один проход по массивам
+  left_iterator erase_left(left_iterator first, left_iterator last) {
+    std::size_t from = first.index();
+    erase_range(lefts, l_partner, rights, r_partner, from, last.index());
+    return left_iterator(this, from);
+  }
+  right_iterator erase_right(right_iterator first, right_iterator last) {
+    std::size_t from = first.index();
+    erase_range(rights, r_partner, lefts, l_partner, from, last.index());
+    return right_iterator(this, from);
+  }
+
+  void clear() noexcept {
+    lefts.clear();
+    rights.clear();
+    l_partner.clear();
+    r_partner.clear();
+  }
+
+  left_iterator find_left(left_t const& left) const {
+    return left_iterator(this, find(lefts, cmp_left, left));
+  }
+  right_iterator find_right(right_t const& right) const {
+    return right_iterator(this, find(rights, cmp_right, right));
+  }
+
+  right_t const& at_left(left_t const& key) const {
+    return paired(find_left(key), end_left());
+  }
+  left_t const& at_right(right_t const& key) const {
+    return paired(find_right(key), end_right());
+  }
+
+  template <typename = std::enable_if<std::is_default_constructible_v<right_t>>>
+  right_t const& at_left_or_default(left_t const& key) {
+    right_iterator node = find_left(key).flip();
+    if (node != end_right()) {
+      return *node;
+    }
+
+    right_t right = right_t();
+    erase_right(right);
+    return *insert(key, std::move(right)).flip();
+  }
+
+  template <typename = std::enable_if<std::is_default_constructible_v<left_t>>>
+  left_t const& at_right_or_default(right_t const& key) {
+    left_iterator node = find_right(key).flip();
+    if (node != end_left()) {
+      return *node;
+    }
+
+    left_t left = left_t();
+    erase_left(left);
+    return *insert(std::move(left), key);
+  }
+
+  left_iterator lower_bound_left(const left_t& left) const {
+    return left_iterator(this, lower(lefts, cmp_left, left));
+  }
+  left_iterator upper_bound_left(const left_t& left) const {
+    return left_iterator(this, upper(lefts, cmp_left, left));
+  }
+
+  right_iterator lower_bound_right(const right_t& right) const {
+    return right_iterator(this, lower(rights, cmp_right, right));
+  }
+  right_iterator upper_bound_right(const right_t& right) const {
+    return right_iterator(this, upper(rights, cmp_right, right));
+  }
+
+  // Поиск по значениям другого типа при прозрачном компараторе
+  template <bimap_details::transparent_key<CompareLeft, left_iterator> K>
+  left_iterator find_left(K const& left) const {
+    return left_iterator(this, find(lefts, cmp_left, left));
+  }
+  template <bimap_details::transparent_key<CompareRight, right_iterator> K>
+  right_iterator find_right(K const& right) const {
+    return right_iterator(this, find(rights, cmp_right, right));
+  }
+  template <bimap_details::transparent_key<CompareLeft, left_iterator> K>
+  right_t const& at_left(K const& key) const {
+    return paired(find_left(key), end_left());
+  }
+  template <bimap_details::transparent_key<CompareRight, right_iterator> K>
+  left_t const& at_right(K const& key) const {
+    return paired(find_right(key), end_right());
+  }
+  template <bimap_details::transparent_key<CompareLeft, left_iterator> K>
+  bool erase_left(K const& left) {
+    return erase_found(find_left(left), end_left());
+  }
+  template <bimap_details::transparent_key<CompareRight, right_iterator> K>
+  bool erase_right(K const& right) {
+    return erase_found(find_right(right), end_right());
+  }
+  template <bimap_details::transparent_key<CompareLeft, left_iterator> K>
+  node_type extract_left(K const& left) {
+    return extract_found(find_left(left), end_left());
+  }
+  template <bimap_details::transparent_key<CompareRight, right_iterator> K>
+  node_type extract_right(K const& right) {
+    return extract_found(find_right(right), end_right());
+  }
+  template <bimap_details::transparent_key<CompareLeft, left_iterator> K>
+  left_iterator lower_bound_left(K const& left) const {
+    return left_iterator(this, lower(lefts, cmp_left, left));
+  }
+  template <bimap_details::transparent_key<CompareLeft, left_iterator> K>
+  left_iterator upper_bound_left(K const& left) const {
+    return left_iterator(this, upper(lefts, cmp_left, left));
+  }
+  template <bimap_details::transparent_key<CompareRight, right_iterator> K>
+  right_iterator lower_bound_right(K const& right) const {
+    return right_iterator(this, lower(rights, cmp_right, right));
+  }
+  template <bimap_details::transparent_key<CompareRight, right_iterator> K>
+  right_iterator upper_bound_right(K const& right) const {
+    return right_iterator(this, upper(rights, cmp_right, right));
+  }
+
+  left_iterator begin_left() const noexcept {
+    return left_iterator(this, 0);
+  }
+  left_iterator end_left() const noexcept {
+    return left_iterator(this, size());
+  }
+
+  right_iterator begin_right() const noexcept {
+    return right_iterator(this, 0);
+  }
+  right_iterator end_right() const noexcept {
+    return right_iterator(this, size());
+  }
+
+  bool empty() const {
+    return lefts.empty();
+  }
+
+  std::size_t size() const {
+    return lefts.size();
+  }
+
+  // поиск массивы не меняет, так что такой bimap всегда заморожен
+  void freeze() noexcept {}
+  void unfreeze() noexcept {}
+  bool frozen() const noexcept {
+    return true;
+  }
+
+  friend bool operator==(bimap const& a, bimap const& b) {
+    if (a.size() != b.size()) {
+      return false;
+    }
+    for (std::size_t i = 0; i < a.size(); i++) {
+      auto equal = [](auto const& cmp, auto const& x, auto const& y) {
+        return !cmp(x, y) && !cmp(y, x);
+      };
+      if (!equal(a.cmp_left, a.lefts[i], b.lefts[i]) ||
+          !equal(b.cmp_right, a.rights[a.l_partner[i]],
+                 b.rights[b.l_partner[i]])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  friend bool operator!=(bimap const& a, bimap const& b) {
+    return !(a == b);
+  }
+
+  void swap(bimap& map) {
+    using std::swap;
+    swap(lefts, map.lefts);
+    swap(rights, map.rights);
+    swap(l_partner, map.l_partner);
+    swap(r_partner, map.r_partner);
+    swap(cmp_left, map.cmp_left);
+    swap(cmp_right, map.cmp_right);
+  }
+
+  allocator_type get_allocator() const {
+    return allocator_type(lefts.get_allocator());
+  }
+
+private:
+  template <typename Keys, typename Compare, typename T>
+  static std::size_t lower(Keys const& keys, Compare const& cmp, T const& key) {
+    return std::lower_bound(keys.begin(), keys.end(), key, cmp) - keys.begin();
+  }
+  template <typename Keys, typename Compare, typename T>
+  static std::size_t upper(Keys const& keys, Compare const& cmp, T const& key) {
+    return std::upper_bound(keys.begin(), keys.end(), key, cmp) - keys.begin();
+  }
+  // позиция ключа или END
+  template <typename Keys, typename Compare, typename T>
+  static std::size_t find(Keys const& keys, Compare const& cmp, T const& key) {
+    std::size_t pos = lower(keys, cmp, key);
+    if (pos == keys.size() || cmp(key, keys[pos])) {
+      return END;
+    }
+    return pos;
+  }
+
+  template <typename T>
+  static auto const& paired(T it, T end) {
+    if (it == end) {
+      throw std::out_of_range("Out of range");
+    }
+    return *it.flip();
+  }
+
+  template <typename T>
+  bool erase_found(T it, T end) {
+    if (it == end) {
+      return false;
+    }
+    if constexpr (std::is_same_v<T, left_iterator>) {
+      erase_left(it);
+    } else {
+      erase_right(it);
+    }
+    return true;
+  }
+
+  template <typename T>
+  node_type extract_found(T it, T end) {
+    if (it == end) {
+      return node_type();
+    }
+    if constexpr (std::is_same_v<T, left_iterator>) {
+      return extract_left(it);
+    } else {
+      return extract_right(it);
+    }
+  }
+
+  // место еще под один элемент; reserve(size() + 1) перевыделял бы память
+  // на каждой вставке
+  template <typename V>
+  static void grow(V& v) {
+    if (v.size() == v.capacity()) {
+      v.reserve(std::max<std::size_t>(2 * v.capacity(), 8));
+    }
+  }
+
+  template <typename T1, typename T2>
+  left_iterator map_insert(T1&& left, T2&& right) {
+    std::size_t pl = lower(lefts, cmp_left, left);
+    std::size_t pr = lower(rights, cmp_right, right);
+    if ((pl != size() && !cmp_left(left, lefts[pl])) ||
+        (pr != size() && !cmp_right(right, rights[pr]))) {
+      return end_left();
+    }
+    // все, что может бросить, до первого изменения: копии ключей и память
+    Left l(std::forward<T1>(left));
+    Right r(std::forward<T2>(right));
+    grow(lefts);
+    grow(rights);
+    grow(l_partner);
+    grow(r_partner);
+
+    lefts.insert(lefts.begin() + pl, std::move(l));
+    try {
+      rights.insert(rights.begin() + pr, std::move(r));
+    } catch (...) {
+      lefts.erase(lefts.begin() + pl);
+      throw;
+    }
+    for (std::size_t& p : l_partner) {
+      p += p >= pr;
+    }
+    for (std::size_t& p : r_partner) {
+      p += p >= pl;
+    }
+    l_partner.insert(l_partner.begin() + pl, pr);
+    r_partner.insert(r_partner.begin() + pr, pl);
+    return left_iterator(this, pl);
+  }
+
+  void erase_pair(std::size_t pl, std::size_t pr) {
+    lefts.erase(lefts.begin() + pl);
+    rights.erase(rights.begin() + pr);
+    l_partner.erase(l_partner.begin() + pl);
+    r_partner.erase(r_partner.begin() + pr);
+    for (std::size_t& p : l_partner) {
+      p -= p > pr;
+    }
+    for (std::size_t& p : r_partner) {
+      p -= p > pl;
+    }
+  }
+
+  // удаляет пары с позициями [from, to) на стороне a; на стороне b они
+  // разбросаны, так что b сжимается одним проходом
+  template <typename KeysA, typename KeysB>
+  static void erase_range(KeysA& a, positions& a_partner, KeysB& b,
+                          positions& b_partner, std::size_t from,
+                          std::size_t to) {
+    if (from == to) {
+      return;
+    }
+    std::vector<bool> dead(b.size());
+    for (std::size_t i = from; i < to; i++) {
+      dead[a_partner[i]] = true;
+    }
+    positions moved(b.size(), 0, a_partner.get_allocator());
+    std::size_t w = 0;
+    for (std::size_t j = 0; j < b.size(); j++) {
+      moved[j] = w;
+      if (!dead[j]) {
+        if (w != j) {
+          b[w] = std::move(b[j]);
+          b_partner[w] = b_partner[j];
+        }
+        w++;
+      }
+    }
+    b.erase(b.begin() + w, b.end());
+    b_partner.erase(b_partner.begin() + w, b_partner.end());
+    a.erase(a.begin() + from, a.begin() + to);
+    a_partner.erase(a_partner.begin() + from, a_partner.begin() + to);
+    for (std::size_t& p : a_partner) {
+      p = moved[p];
+    }
+    for (std::size_t& p : b_partner) {
+      p -= p >= to ? to - from : 0;
+    }
+  }
+
+  template <typename InputIt, typename Sentinel>
+  void assign_range(InputIt first, Sentinel last, bool left_sorted) {
+    std::vector<Left, rebind<Left>> ls(lefts.get_allocator());
+    std::vector<Right, rebind<Right>> rs(rights.get_allocator());
+    for (; first != last; ++first) {
+      auto&& pair = *first;
+      ls.push_back(std::get<0>(std::forward<decltype(pair)>(pair)));
+      rs.push_back(std::get<1>(std::forward<decltype(pair)>(pair)));
+    }
+    auto [by_left, by_right] = bimap_details::sorted_unique(
+        ls.size(),
+        [&](std::size_t a, std::size_t b) { return cmp_left(ls[a], ls[b]); },
+        [&](std::size_t a, std::size_t b) { return cmp_right(rs[a], rs[b]); },
+        left_sorted);
+
+    // позиция каждой взятой пары в левом и правом порядке
+    positions pos_l(ls.size(), 0, l_partner.get_allocator());
+    positions pos_r(ls.size(), 0, l_partner.get_allocator());
+    for (std::size_t k = 0; k < by_left.size(); k++) {
+      pos_l[by_left[k]] = k;
+      pos_r[by_right[k]] = k;
+    }
+    lefts.reserve(by_left.size());
+    rights.reserve(by_right.size());
+    l_partner.reserve(by_left.size());
+    r_partner.reserve(by_right.size());
+    for (std::size_t k = 0; k < by_left.size(); k++) {
+      lefts.push_back(std::move(ls[by_left[k]]));
+      l_partner.push_back(pos_r[by_left[k]]);
+      rights.push_back(std::move(rs[by_right[k]]));
+      r_partner.push_back(pos_l[by_right[k]]);
+    }
+  }
+};
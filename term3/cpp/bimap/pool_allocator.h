@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace bimap_details {
+
+// все слэбы общие на программу: узел, освобожденный на одном потоке, просто
+// попадет в список свободных этого потока, так что отдавать память
+// системе можно только когда живых узлов не осталось вообще. Зато память
+// завершившихся потоков не теряется, ее подбирают остальные (см. pool)
+class slab_registry {
+public:
+  static slab_registry& instance() {
+    static slab_registry registry;
+    return registry;
+  }
+
+  void* allocate(std::size_t size, std::size_t align) {
+    void* slab = ::operator new(size, std::align_val_t(align));
+    std::lock_guard<std::mutex> lock(mut);
+    try {
+      slabs.push_back({slab, align});
+    } catch (...) {
+      ::operator delete(slab, std::align_val_t(align));
+      throw;
+    }
+    return slab;
+  }
+
+  std::size_t size() {
+    std::lock_guard<std::mutex> lock(mut);
+    return slabs.size();
+  }
+
+  // статический bimap может пережить реестр, тогда его узлы должны остаться
+  // на месте, поэтому память освобождается только если все узлы уже отданы
+  ~slab_registry() {
+    if (live.load() != 0) {
+      return;
+    }
+    for (auto [slab, align] : slabs) {
+      ::operator delete(slab, std::align_val_t(align));
+    }
+  }
+
+  static inline std::atomic<std::size_t> live = 0;
+
+private:
+  slab_registry() = default;
+
+  std::mutex mut;
+  std::vector<std::pair<void*, std::size_t>> slabs;
+};
+
+// пул блоков одного размера, у каждого потока свой список свободных и свой
+// текущий слэб, так что выделение и освобождение обходятся без блокировок.
+// Поток при завершении отдает свой список и остаток слэба в общий стек
+// брошенных блоков, и поток, у которого кончились свои, забирает его
+// целиком, прежде чем просить новый слэб
+template <std::size_t Size, std::size_t Align>
+class pool {
+  struct free_block {
+    free_block* next;
+  };
+
+  struct cache {
+    free_block* head = nullptr;
+    char* cur = nullptr;
+    char* last = nullptr;
+
+    ~cache() {
+      for (; cur != last; cur += block) {
+        head = ::new (cur) free_block{head};
+      }
+      if (head != nullptr) {
+        free_block* tail = head;
+        while (tail->next != nullptr) {
+          tail = tail->next;
+        }
+        // снимают стек только целиком, так что ABA тут не бывает
+        tail->next = orphans.load(std::memory_order_relaxed);
+        while (!orphans.compare_exchange_weak(tail->next, head,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed)) {}
+      }
+      // узлы, освобожденные этим потоком позже (статический bimap),
+      // просто останутся в этом списке до конца программы
+      head = nullptr;
+      cur = last = nullptr;
+    }
+  };
+
+  static constexpr std::size_t align = std::max(Align, alignof(free_block));
+  static constexpr std::size_t block =
+      (std::max(Size, sizeof(free_block)) + align - 1) / align * align;
+  static constexpr std::size_t slab_size =
+      std::max<std::size_t>(64 << 10, 32 * block);
+
+  static inline std::atomic<free_block*> orphans = nullptr;
+  static inline thread_local cache local;
+
+public:
+  static void* allocate() {
+    slab_registry::live.fetch_add(1, std::memory_order_relaxed);
+    cache& c = local;
+    if (c.head == nullptr && c.cur == c.last &&
+        orphans.load(std::memory_order_relaxed) != nullptr) {
+      c.head = orphans.exchange(nullptr, std::memory_order_acquire);
+    }
+    if (c.head != nullptr) {
+      free_block* res = c.head;
+      c.head = c.head->next;
+      return res;
+    }
+    if (c.cur == c.last) {
+      try {
+        c.cur = static_cast<char*>(
+            slab_registry::instance().allocate(slab_size, align));
+      } catch (...) {
+        slab_registry::live.fetch_sub(1, std::memory_order_relaxed);
+        throw;
+      }
+      c.last = c.cur + slab_size / block * block;
+    }
+    void* res = c.cur;
+    c.cur += block;
+    return res;
+  }
+
+  static void deallocate(void* p) noexcept {
+    cache& c = local;
+    c.head = ::new (p) free_block{c.head};
+    slab_registry::live.fetch_sub(1, std::memory_order_relaxed);
+  }
+};
+
+// аллокатор без состояния: любые два экземпляра взаимозаменяемы, поэтому
+// узлы можно свободно переносить между бимапами
+template <typename T>
+class pool_allocator {
+public:
+  using value_type = T;
+
+  pool_allocator() noexcept = default;
+  template <typename U>
+  pool_allocator(pool_allocator<U> const&) noexcept {}
+
+  T* allocate(std::size_t n) {
+    if (n != 1) {
+      return std::allocator<T>().allocate(n);
+    }
+    return static_cast<T*>(pool<sizeof(T), alignof(T)>::allocate());
+  }
+
+  void deallocate(T* p, std::size_t n) noexcept {
+    if (n != 1) {
+      std::allocator<T>().deallocate(p, n);
+      return;
+    }
+    pool<sizeof(T), alignof(T)>::deallocate(p);
+  }
+
+  friend bool operator==(pool_allocator const&, pool_allocator const&) {
+    return true;
+  }
+};
+
+} // namespace bimap_details
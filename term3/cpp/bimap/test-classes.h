@@ -90,3 +90,37 @@ public:
   address_checking_object& operator=(address_checking_object const& other);
   ~address_checking_object();
 };
+
+// общий счетчик на все rebind-ы
+struct allocation_counter {
+  static inline size_t allocated = 0;
+};
+
+// аллокатор, считающий живые выделения; экземпляры равны только при
+// равном id, чтобы проверять, какой из них досталось узлу
+template <typename T>
+struct counting_allocator : allocation_counter {
+  using value_type = T;
+
+  int id = 0;
+
+  counting_allocator() = default;
+  explicit counting_allocator(int id) : id(id) {}
+  template <typename U>
+  counting_allocator(counting_allocator<U> const& other) : id(other.id) {}
+
+  T* allocate(size_t n) {
+    allocated += n;
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T* p, size_t n) {
+    allocated -= n;
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <typename U>
+  friend bool operator==(counting_allocator const& a,
+                         counting_allocator<U> const& b) {
+    return a.id == b.id;
+  }
+};
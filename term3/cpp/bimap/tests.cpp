@@ -1,6 +1,12 @@
+#include <atomic>
+#include <map>
 #include <random>
+#include <set>
+#include <string_view>
+#include <thread>
 
 #include "bimap.h"
+#include "concurrent_bimap.h"
 #include "test-classes.h"
 
 TEST(bimap, leak_check) {
@@ -279,6 +285,59 @@ TEST(bimap, erase_range) {
   EXPECT_TRUE(b.empty());
 }
 
+TEST(bimap, erase_range_random) {
+  std::mt19937 e(21);
+  bimap<int, int> b;
+  std::map<int, int> expected;
+  for (int i = 0; i < 2000; i++) {
+    int k = e() % 10000;
+    if (expected.emplace(k, (k * 7919) % 10007).second) {
+      b.insert(k, (k * 7919) % 10007);
+    }
+  }
+  while (!expected.empty()) {
+    int a = e() % 10000, c = e() % 10000;
+    if (a > c) {
+      std::swap(a, c);
+    }
+    if (e() % 2 == 0) {
+      auto it = b.erase_left(b.lower_bound_left(a), b.lower_bound_left(c));
+      expected.erase(expected.lower_bound(a), expected.lower_bound(c));
+      auto next = expected.lower_bound(c);
+      EXPECT_EQ(it == b.end_left(), next == expected.end());
+    } else {
+      // по правой стороне удаляются пары, чьи right в [a, c)
+      b.erase_right(b.lower_bound_right(a), b.lower_bound_right(c));
+      std::erase_if(expected,
+                    [&](auto const& p) { return a <= p.second && p.second < c; });
+    }
+    ASSERT_EQ(b.size(), expected.size());
+    auto it = b.begin_left();
+    for (auto [l, r] : expected) {
+      EXPECT_EQ(*it, l);
+      EXPECT_EQ(b.at_right(r), l);
+      ++it;
+    }
+  }
+  EXPECT_TRUE(b.empty());
+}
+
+TEST(bimap, clear) {
+  {
+    bimap<address_checking_object, int> b;
+    for (int i = 0; i < 100; i++) {
+      b.insert(i, -i);
+    }
+    b.clear();
+    EXPECT_TRUE(b.empty());
+    EXPECT_EQ(b.begin_left(), b.end_left());
+    EXPECT_EQ(b.begin_right(), b.end_right());
+    b.insert(1, 2);
+    EXPECT_EQ(b.at_left(1), 2);
+  }
+  address_checking_object::expect_no_instances();
+}
+
 TEST(bimap, lower_bound) {
   bimap<int, int> b;
 
@@ -312,6 +371,50 @@ TEST(bimap, upper_bound) {
   EXPECT_EQ(*b.upper_bound_right(-100), 2);
   EXPECT_EQ(b.upper_bound_right(100), b.end_right());
   EXPECT_EQ(b.upper_bound_left(400), b.end_left());
+  EXPECT_EQ(*b.upper_bound_left(3), 8);
+  EXPECT_EQ(*b.upper_bound_right(3), 4);
+  EXPECT_EQ(b.upper_bound_right(66), b.end_right());
+}
+
+// правые значения -- это минус левые
+template <typename Map>
+void check_bounds(Map& b, std::set<int> const& keys) {
+  std::set<int> rights;
+  for (int k : keys) {
+    rights.insert(-k);
+  }
+  auto same = [](auto it, auto end, auto expected, auto expected_end) {
+    EXPECT_EQ(it == end, expected == expected_end);
+    if (it != end && expected != expected_end) {
+      EXPECT_EQ(*it, *expected);
+    }
+  };
+  for (int k = -1; k <= 2001; k++) {
+    same(b.lower_bound_left(k), b.end_left(), keys.lower_bound(k), keys.end());
+    same(b.upper_bound_left(k), b.end_left(), keys.upper_bound(k), keys.end());
+    same(b.lower_bound_right(-k), b.end_right(), rights.lower_bound(-k),
+         rights.end());
+    same(b.upper_bound_right(-k), b.end_right(), rights.upper_bound(-k),
+         rights.end());
+  }
+}
+
+TEST(bimap, bounds_random) {
+  std::mt19937 e(2020);
+  bimap<int, int> b;
+  flat_bimap<int, int> f;
+  std::set<int> keys;
+  for (int i = 0; i < 500; i++) {
+    int k = e() % 1000 * 2;
+    if (keys.insert(k).second) {
+      b.insert(k, -k);
+      f.insert(k, -k);
+    }
+  }
+  check_bounds(b, keys);
+  check_bounds(f, keys);
+  b.freeze();
+  check_bounds(b, keys);
 }
 
 TEST(bimap, assigment) {
@@ -432,6 +535,33 @@ TEST(bimap, iterating) {
   EXPECT_EQ(right_values, right_values_inv);
 }
 
+template <typename Map>
+void check_standard_algorithms() {
+  using traits = std::iterator_traits<typename Map::right_iterator>;
+  static_assert(std::is_same_v<typename traits::iterator_category,
+                               std::bidirectional_iterator_tag>);
+  static_assert(std::is_same_v<typename traits::value_type, int>);
+  Map b;
+  for (int i = 0; i < 10; i++) {
+    b.insert(i, 100 - i);
+  }
+  EXPECT_EQ(std::distance(b.begin_left(), b.end_left()), 10);
+  EXPECT_EQ(*std::prev(b.end_right()), 100);
+  EXPECT_EQ(*std::next(b.begin_left(), 3), 3);
+  EXPECT_TRUE(std::is_sorted(b.begin_right(), b.end_right()));
+  EXPECT_EQ(std::find(b.begin_left(), b.end_left(), 7), b.find_left(7));
+  std::vector<int> rights(b.begin_right(), b.end_right());
+  EXPECT_EQ(rights.front(), 91);
+}
+
+TEST(bimap, standard_algorithms) {
+  check_standard_algorithms<bimap<int, int>>();
+}
+
+TEST(flat_bimap, standard_algorithms) {
+  check_standard_algorithms<flat_bimap<int, int>>();
+}
+
 TEST(bimap, swap) {
   bimap<int, int> b, b1;
   b.insert(3, 4);
@@ -443,6 +573,402 @@ TEST(bimap, swap) {
   EXPECT_EQ(*b.find_right(3), 3);
 }
 
+TEST(bimap, node_handle) {
+  bimap<int, int> a, b;
+  a.insert(1, 10);
+  a.insert(2, 20);
+  auto nh = a.extract_left(1);
+  EXPECT_EQ(a.size(), 1);
+  EXPECT_EQ(a.find_left(1), a.end_left());
+  EXPECT_EQ(a.find_right(10), a.end_right());
+  ASSERT_FALSE(nh.empty());
+  nh.left() = 5;
+  auto it = b.insert(std::move(nh));
+  EXPECT_TRUE(nh.empty());
+  EXPECT_EQ(*it, 5);
+  EXPECT_EQ(b.at_left(5), 10);
+
+  auto nh2 = a.extract_right(a.find_right(20));
+  EXPECT_TRUE(a.empty());
+  EXPECT_EQ(nh2.left(), 2);
+  EXPECT_FALSE(a.extract_left(2));
+  a.insert(std::move(nh2));
+  EXPECT_EQ(a.at_right(20), 2);
+}
+
+TEST(bimap, node_handle_insert_exist) {
+  bimap<int, int> a;
+  a.insert(1, 10);
+  a.insert(2, 20);
+  auto nh = a.extract_left(a.begin_left());
+  nh.right() = 20;
+  EXPECT_EQ(a.insert(std::move(nh)), a.end_left());
+  ASSERT_FALSE(nh.empty());
+  EXPECT_EQ(nh.left(), 1);
+  nh.right() = 30;
+  EXPECT_NE(a.insert(std::move(nh)), a.end_left());
+  EXPECT_EQ(a.at_left(1), 30);
+  EXPECT_EQ(a.size(), 2);
+}
+
+TEST(bimap, custom_allocator) {
+  using alloc = counting_allocator<std::pair<int, int>>;
+  {
+    bimap<int, int, std::less<int>, std::less<int>, alloc> b(
+        std::less<int>(), std::less<int>(), alloc(42));
+    for (int i = 0; i < 10; i++) {
+      b.insert(i, -i);
+    }
+    EXPECT_EQ(alloc::allocated, 10);
+    auto nh = b.extract_left(3);
+    EXPECT_EQ(nh.get_allocator().id, 42);
+    b.erase_left(4);
+    EXPECT_EQ(alloc::allocated, 9);
+    auto copy = b;
+    EXPECT_EQ(copy.get_allocator().id, 42);
+    EXPECT_EQ(alloc::allocated, 17);
+  }
+  EXPECT_EQ(alloc::allocated, 0);
+}
+
+TEST(bimap, pool_allocator) {
+  pool_bimap<int, int> a;
+  for (int i = 0; i < 1000; i++) {
+    a.insert(i, -i);
+  }
+  a.erase_left(a.begin_left(), a.find_left(500));
+  auto nh = a.extract_left(700);
+  pool_bimap<int, int> b = a;
+  b.insert(std::move(nh));
+  EXPECT_EQ(a.size(), 499);
+  EXPECT_EQ(b.size(), 500);
+  EXPECT_EQ(b.at_right(-700), 700);
+  EXPECT_EQ(b.at_left(999), -999);
+}
+
+TEST(bimap, pool_allocator_thread_exit) {
+  const int n = 100000;
+  auto fill = [&] {
+    pool_bimap<int, int> b;
+    for (int i = 0; i < n; i++) {
+      b.insert(i, i);
+    }
+  };
+  std::thread(fill).join();
+  // второй поток живет на блоках, оставшихся от первого
+  std::size_t slabs = bimap_details::slab_registry::instance().size();
+  std::thread(fill).join();
+  EXPECT_EQ(bimap_details::slab_registry::instance().size(), slabs);
+}
+
+TEST(bimap, sequential_lookup) {
+  bimap<int, int> b;
+  const int n = 100000;
+  for (int i = 0; i < n; i++) {
+    b.insert(i, n - i);
+  }
+  // после последовательной вставки дерево -- одна длинная ветка
+  for (int i = 0; i < n; i++) {
+    ASSERT_EQ(b.at_left(i), n - i);
+    ASSERT_EQ(*b.lower_bound_right(n - i), n - i);
+  }
+  EXPECT_EQ(b.find_left(n), b.end_left());
+  EXPECT_EQ(b.lower_bound_left(n), b.end_left());
+  EXPECT_EQ(*b.lower_bound_right(0), 1);
+}
+
+TEST(bimap, frozen) {
+  bimap<int, int> b;
+  const int n = 10000;
+  for (int i = 0; i < n; i++) {
+    b.insert(2 * i, -i);
+  }
+  b.freeze();
+  EXPECT_TRUE(b.frozen());
+  std::vector<std::thread> readers;
+  std::atomic<int> mismatches = 0;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&b, &mismatches, t] {
+      for (int i = t; i < n; i += 2) {
+        if (b.at_left(2 * i) != -i || *b.lower_bound_left(2 * i - 1) != 2 * i ||
+            b.find_right(-i).flip() != b.find_left(2 * i)) {
+          mismatches++;
+        }
+      }
+    });
+  }
+  for (auto& th : readers) {
+    th.join();
+  }
+  EXPECT_EQ(mismatches, 0);
+  b.insert(1, 1);
+  EXPECT_EQ(*b.lower_bound_left(1), 1);
+  b.unfreeze();
+  EXPECT_FALSE(b.frozen());
+  EXPECT_EQ(b.at_right(1), 1);
+  EXPECT_EQ(b.size(), n + 1);
+}
+
+TEST(bimap, frozen_modifications) {
+  bimap<int, int> b;
+  b.freeze();
+  std::map<int, int> expected;
+  std::mt19937 e(4242);
+  // сначала по порядку, чтобы без перестроек дерево выродилось в список
+  for (int i = 0; i < 3000; i++) {
+    b.insert(i, -i);
+    expected.emplace(i, -i);
+  }
+  for (int i = 0; i < 20000; i++) {
+    int key = e() % 5000;
+    if (e() % 3 == 0) {
+      EXPECT_EQ(b.erase_left(key), expected.erase(key) == 1);
+    } else if (expected.emplace(key, -key).second) {
+      b.insert(key, -key);
+    }
+  }
+  EXPECT_TRUE(b.frozen());
+  EXPECT_EQ(b.size(), expected.size());
+  auto it = b.begin_left();
+  for (auto [l, r] : expected) {
+    EXPECT_EQ(*it, l);
+    EXPECT_EQ(b.at_right(r), l);
+    ++it;
+  }
+}
+
+TEST(bimap, frozen_swap) {
+  bimap<int, int> a, b;
+  for (int i = 0; i < 100; i++) {
+    a.insert(i, -i);
+  }
+  a.freeze();
+  a.swap(b);
+  EXPECT_FALSE(a.frozen());
+  EXPECT_TRUE(b.frozen());
+  EXPECT_EQ(b.at_left(42), -42);
+
+  bimap<int, int> moved(std::move(b));
+  EXPECT_TRUE(moved.frozen());
+  bimap<int, int> copy = moved;
+  EXPECT_TRUE(copy.frozen());
+  EXPECT_EQ(copy, moved);
+  b = a;
+  EXPECT_FALSE(b.frozen());
+}
+
+TEST(bimap, range_constructor) {
+  std::mt19937 e(1337);
+  std::vector<std::pair<int, int>> pairs;
+  for (int i = 0; i < 5000; i++) {
+    pairs.emplace_back(e() % 1000, e() % 1000);
+  }
+  bimap<int, int> expected;
+  for (auto [l, r] : pairs) {
+    expected.insert(l, r);
+  }
+  bimap<int, int> b(pairs.begin(), pairs.end());
+  EXPECT_EQ(b.size(), expected.size());
+  EXPECT_EQ(b, expected);
+
+  bimap<int, int> empty(pairs.begin(), pairs.begin());
+  EXPECT_TRUE(empty.empty());
+}
+
+TEST(bimap, from_sorted) {
+  std::vector<std::pair<int, std::string>> pairs;
+  for (int i = 0; i < 1000; i++) {
+    pairs.emplace_back(i, std::to_string(1000 - i));
+  }
+  pairs.emplace_back(1000, "1");
+  auto b = bimap<int, std::string>::from_sorted(pairs);
+  EXPECT_EQ(b.size(), 1000);
+  EXPECT_EQ(b.at_right("1"), 999);
+  EXPECT_EQ(b.find_left(1000), b.end_left());
+
+  std::swap(pairs[0], pairs[500]);
+  auto unsorted = bimap<int, std::string>::from_sorted(pairs);
+  EXPECT_EQ(unsorted, b);
+}
+
+TEST(bimap, range_constructor_throwing) {
+  std::vector<std::pair<address_checking_object, int>> pairs;
+  for (int i = 0; i < 10; i++) {
+    pairs.emplace_back(i, i);
+  }
+  address_checking_object::set_copy_throw_countdown(5);
+  EXPECT_ANY_THROW((bimap<address_checking_object, int>(pairs.begin(),
+                                                         pairs.end())));
+  address_checking_object::set_copy_throw_countdown(0);
+  pairs.clear();
+  address_checking_object::expect_no_instances();
+}
+
+TEST(flat_bimap, simple) {
+  flat_bimap<int, std::string> b;
+  EXPECT_NE(b.insert(3, "c"), b.end_left());
+  EXPECT_NE(b.insert(1, "b"), b.end_left());
+  EXPECT_NE(b.insert(2, "a"), b.end_left());
+  EXPECT_EQ(b.insert(2, "d"), b.end_left());
+  EXPECT_EQ(b.insert(4, "a"), b.end_left());
+  EXPECT_EQ(b.size(), 3);
+
+  EXPECT_EQ(*b.begin_left(), 1);
+  EXPECT_EQ(*b.begin_left().flip(), "b");
+  EXPECT_EQ(*b.begin_right().flip(), 2);
+  EXPECT_EQ(b.end_left().flip(), b.end_right());
+  EXPECT_EQ(b.end_right().flip(), b.end_left());
+  EXPECT_EQ(b.at_right("c"), 3);
+  EXPECT_THROW(b.at_left(5), std::out_of_range);
+  EXPECT_EQ(*b.lower_bound_left(2), 2);
+  EXPECT_EQ(*b.upper_bound_left(2), 3);
+  EXPECT_EQ(b.upper_bound_right("c"), b.end_right());
+
+  EXPECT_EQ(*b.erase_left(b.find_left(2)), 3);
+  EXPECT_EQ(b.find_right("a"), b.end_right());
+  EXPECT_EQ(b.at_left(3), "c");
+  EXPECT_TRUE(b.erase_right("b"));
+  EXPECT_EQ(b.size(), 1);
+  EXPECT_EQ(b.at_right("c"), 3);
+}
+
+TEST(flat_bimap, node_handle) {
+  flat_bimap<int, int> a, b;
+  a.insert(1, 10);
+  a.insert(2, 20);
+  auto nh = a.extract_right(10);
+  nh.right() = 30;
+  b.insert(std::move(nh));
+  EXPECT_TRUE(nh.empty());
+  EXPECT_EQ(b.at_left(1), 30);
+  EXPECT_EQ(a.size(), 1);
+  EXPECT_EQ(a.at_right(20), 2);
+}
+
+TEST(flat_bimap, compare_to_tree) {
+  std::mt19937 e(1488228);
+  bimap<int, int> tree;
+  flat_bimap<int, int> flat;
+  for (int i = 0; i < 20000; i++) {
+    int op = e() % 10;
+    int l = e() % 2000, r = e() % 2000;
+    if (op < 6) {
+      EXPECT_EQ(tree.insert(l, r) == tree.end_left(),
+                flat.insert(l, r) == flat.end_left());
+    } else if (op < 9) {
+      EXPECT_EQ(tree.erase_left(l), flat.erase_left(l));
+    } else {
+      auto tf = tree.lower_bound_right(r), tl = tree.lower_bound_right(r + 50);
+      auto ff = flat.lower_bound_right(r), fl = flat.lower_bound_right(r + 50);
+      tree.erase_right(tf, tl);
+      flat.erase_right(ff, fl);
+    }
+    if (i % 500 == 0) {
+      ASSERT_EQ(tree.size(), flat.size());
+      auto fit = flat.begin_left();
+      for (auto it = tree.begin_left(); it != tree.end_left(); it++, fit++) {
+        ASSERT_EQ(*it, *fit);
+        ASSERT_EQ(*it.flip(), *fit.flip());
+        ASSERT_EQ(fit.flip().flip(), fit);
+      }
+    }
+  }
+  auto copy = flat;
+  EXPECT_EQ(copy, flat);
+  std::vector<std::pair<int, int>> pairs;
+  for (auto it = tree.begin_left(); it != tree.end_left(); it++) {
+    pairs.emplace_back(*it, *it.flip());
+  }
+  EXPECT_EQ((flat_bimap<int, int>::from_sorted(pairs)), flat);
+}
+
+// string_view в string неявно не превращается, так что без прозрачного
+// компаратора эти вызовы бы не скомпилировались
+template <typename Map>
+void check_transparent_lookup() {
+  Map b;
+  b.insert("one", 1);
+  b.insert("two", 2);
+  b.insert("three", 3);
+  std::string_view two = "two";
+  EXPECT_EQ(*b.find_left(two), "two");
+  EXPECT_EQ(b.find_left(std::string_view("four")), b.end_left());
+  EXPECT_EQ(b.at_left(two), 2);
+  EXPECT_THROW(b.at_left(std::string_view("zero")), std::out_of_range);
+  EXPECT_EQ(*b.lower_bound_left(std::string_view("p")), "three");
+  EXPECT_EQ(*b.find_left("one").flip(), 1);
+
+  auto nh = b.extract_left(std::string_view("one"));
+  ASSERT_FALSE(nh.empty());
+  EXPECT_EQ(nh.right(), 1);
+  EXPECT_TRUE(b.erase_left(two));
+  EXPECT_FALSE(b.erase_left(two));
+  EXPECT_EQ(b.size(), 1);
+  EXPECT_EQ(b.erase_left(b.begin_left()), b.end_left());
+  EXPECT_TRUE(b.empty());
+}
+
+TEST(bimap, transparent_lookup) {
+  check_transparent_lookup<bimap<std::string, int, std::less<>>>();
+}
+
+TEST(flat_bimap, transparent_lookup) {
+  check_transparent_lookup<flat_bimap<std::string, int, std::less<>>>();
+}
+
+TEST(concurrent_bimap, readers_and_writers) {
+  concurrent_bimap<int, int> b;
+  const int writers = 4, per_writer = 5000;
+  std::atomic<bool> done = false;
+  std::atomic<int> mismatches = 0;
+  std::vector<std::thread> threads;
+  for (int w = 0; w < writers; w++) {
+    threads.emplace_back([&b, w] {
+      for (int i = w; i < writers * per_writer; i += writers) {
+        b.insert(i, -i);
+        if (i % 3 == 0) {
+          b.erase_right(-i);
+        }
+      }
+    });
+  }
+  for (int r = 0; r < 4; r++) {
+    threads.emplace_back([&, r] {
+      std::mt19937 e(r);
+      while (!done) {
+        int key = e() % (writers * per_writer);
+        auto right = b.find_left(key);
+        if (right && *right != -key) {
+          mismatches++;
+        }
+        auto left = b.find_right(-key);
+        if (left && *left != key) {
+          mismatches++;
+        }
+      }
+    });
+  }
+  for (int w = 0; w < writers; w++) {
+    threads[w].join();
+  }
+  done = true;
+  for (size_t t = writers; t < threads.size(); t++) {
+    threads[t].join();
+  }
+  EXPECT_EQ(mismatches, 0);
+  EXPECT_EQ(b.size(), writers * per_writer - (writers * per_writer + 2) / 3);
+  EXPECT_EQ(b.at_left(1), -1);
+  EXPECT_FALSE(b.contains_left(3));
+  EXPECT_THROW(b.at_right(-3), std::out_of_range);
+  size_t ordered = b.read([](auto const& map) {
+    return std::is_sorted(map.begin_left(), map.end_left(),
+                          [](int x, int y) { return x < y; })
+               ? map.size()
+               : 0;
+  });
+  EXPECT_EQ(ordered, b.size());
+}
+
 template <typename T>
 std::vector<std::pair<T, T>>
 eliminate_same(std::vector<T>& lefts, std::vector<T>& rights, std::mt19937& e) {
@@ -469,6 +995,10 @@ eliminate_same(std::vector<T>& lefts, std::vector<T>& rights, std::mt19937& e) {
 
 template struct bimap<int, non_default_constructible>;
 template struct bimap<non_default_constructible, int>;
+template struct bimap<int, non_default_constructible,
+                      std::less<int>, std::less<non_default_constructible>,
+                      std::allocator<std::pair<int, non_default_constructible>>,
+                      bimap_details::flat_policy>;
 
 static constexpr uint32_t seed = 1488228;
 
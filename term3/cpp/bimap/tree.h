@@ -1,17 +1,82 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <cstring>
 #include <memory>
+#include <new>
+#include <numeric>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bimap_details {
+// устройство сторон bimap: splay-деревья на узлах (tree.h) или
+// отсортированные массивы ключей (flat.h)
+struct tree_policy {};
+struct flat_policy {};
+} // namespace bimap_details
 
 template <typename Left, typename Right, typename CompareLeft,
-          typename CompareRight>
+          typename CompareRight, typename Allocator, typename Policy>
 class bimap;
 
 namespace bimap_details {
 struct left_t;
 struct right_t;
 
+// компаратор умеет сравнивать ключ с чем-то другим (std::less<> и т.п.),
+// тогда поиск принимает любой такой тип без создания временного ключа
+template <typename Compare>
+concept transparent = requires { typename Compare::is_transparent; };
+
+// ключ для такого поиска; итераторы исключены, чтобы erase(it) и extract(it)
+// не путались с удалением по ключу
+template <typename K, typename Compare, typename Iterator>
+concept transparent_key =
+    transparent<Compare> && !std::is_convertible_v<K const&, Iterator>;
+
+// Сборка bimap из n пар разом. less_left и less_right сравнивают номера пар
+// по соответствующей стороне. Возвращает номера оставшихся пар в левом и в
+// правом порядке. Пара отбрасывается, если ее left или right заняты взятой
+// раньше парой -- ровно как при вставке по одной в порядке номеров.
+template <typename LessLeft, typename LessRight>
+std::pair<std::vector<std::size_t>, std::vector<std::size_t>>
+sorted_unique(std::size_t n, LessLeft less_left, LessRight less_right,
+              bool left_sorted) {
+  std::vector<std::size_t> by_left(n), by_right(n);
+  std::iota(by_left.begin(), by_left.end(), 0);
+  std::iota(by_right.begin(), by_right.end(), 0);
+  if (!left_sorted ||
+      !std::is_sorted(by_left.begin(), by_left.end(), less_left)) {
+    std::stable_sort(by_left.begin(), by_left.end(), less_left);
+  }
+  std::stable_sort(by_right.begin(), by_right.end(), less_right);
+
+  // номер группы равных ключей для каждой пары
+  auto groups = [n](std::vector<std::size_t> const& order, auto& less) {
+    std::vector<std::size_t> group(n);
+    for (std::size_t k = 1; k < n; k++) {
+      group[order[k]] = group[order[k - 1]] + less(order[k - 1], order[k]);
+    }
+    return group;
+  };
+  std::vector<std::size_t> group_l = groups(by_left, less_left);
+  std::vector<std::size_t> group_r = groups(by_right, less_right);
+
+  std::vector<bool> taken_l(n), taken_r(n), keep(n);
+  for (std::size_t i = 0; i < n; i++) {
+    if (!taken_l[group_l[i]] && !taken_r[group_r[i]]) {
+      keep[i] = taken_l[group_l[i]] = taken_r[group_r[i]] = true;
+    }
+  }
+  auto dropped = [&keep](std::size_t i) { return !keep[i]; };
+  std::erase_if(by_left, dropped);
+  std::erase_if(by_right, dropped);
+  return {std::move(by_left), std::move(by_right)};
+}
+
 struct node_base {
   node_base* leftmost() noexcept {
     node_base* root = this;
@@ -95,7 +160,7 @@ struct node : node_base_value<T1, left_t>, node_base_value<T2, right_t> {
 template <typename Type, typename Compare, typename Tag>
 class map : public Compare {
   template <typename Left, typename Right, typename CompareLeft,
-            typename CompareRight>
+            typename CompareRight, typename Allocator, typename Policy>
   friend class ::bimap;
   using Node = node_base;
 
@@ -108,7 +173,17 @@ class map : public Compare {
 
   // ну и так как выкинули root, переместим корень дерева на end_node.l,
   // а указатель на end_node в соседнем дереве на end_node.r
-  Node end_node;
+  // поиск перестраивает дерево (splay), поэтому даже константный
+  // find меняет корень
+  mutable Node end_node;
+  // замороженное дерево поиск не трогает, его можно читать из многих потоков.
+  // Вставка и удаление в нем тоже не splay-ят, а держат дерево scapegoat-ом:
+  // глубина не больше log_{3/2} от числа узлов, за это отвечает перестройка
+  // слишком тяжелых поддеревьев
+  bool frozen = false;
+  std::size_t count = 0;
+  // наибольший размер со времени последней полной перестройки
+  std::size_t max_count = 0;
 
 public:
   map() = default;
@@ -116,21 +191,26 @@ public:
   map(Compare&& cmp) : Compare(std::move(cmp)) {}
 
   Node* begin() const noexcept {
-    return const_cast<Node*>(&end_node)->leftmost();
+    return end_node.leftmost();
   }
   Node* end() const noexcept {
-    return const_cast<Node*>(&end_node);
+    return &end_node;
   }
   Node* insert(Node* new_node) {
+    // узел мог быть вынут из другого дерева вместе со старыми ссылками
+    new_node->l = new_node->r = new_node->p = nullptr;
+    count++;
+    max_count = std::max(max_count, count);
     if (end_node.l == nullptr) {
       end_node.l = new_node;
       linkEndNode();
       return end_node.l;
     }
     Node* par = end_node.l;
-    new_node->l = new_node->r = new_node->p = nullptr;
+    std::size_t depth = 1;
 
     while (true) {
+      depth++;
       int cmp = compare(par, new_node);
       if (cmp == 0) {
         break;
@@ -155,9 +235,24 @@ public:
         }
       }
     }
+    if (frozen) {
+      if (depth > std::log(count) / std::log(1.5) + 1) {
+        rebalanceAbove(new_node);
+      }
+      return new_node;
+    }
     return splay(par);
   }
   void erase(Node* del_node) noexcept {
+    count--;
+    if (frozen) {
+      removeInPlace(del_node);
+      if (3 * count < 2 * max_count) {
+        rebuild(end_node.l, count);
+        max_count = count;
+      }
+      return;
+    }
     if (splay(del_node) == nullptr) {
       return;
     }
@@ -178,20 +273,136 @@ public:
       end_node.l->p = &end_node;
     }
   }
-  Node* find(const Type& val) const {
-    return exists(end_node.l, val);
+  template <typename K>
+  Node* find(const K& val) const {
+    Node* n = locate(val);
+    if (n == nullptr || compare(cast(n)->val1, val) != 0) {
+      return end();
+    }
+    return n;
   }
-  Node* lower(const Type& val) const {
-    return lower(end_node.l, val);
+  template <typename K>
+  Node* lower(const K& val) const {
+    if (frozen) {
+      return bound<false>(val);
+    }
+    Node* n = splayTo(val);
+    if (n == nullptr) {
+      return end();
+    }
+    // n -- ближайший к val узел, если он меньше, то ответ следующий
+    return larger(cast(n)->val1, val) ? n->next() : n;
   }
-  Node* upper(const Type& val) const {
-    return upper(end_node.l, val);
+  template <typename K>
+  Node* upper(const K& val) const {
+    if (frozen) {
+      return bound<true>(val);
+    }
+    Node* n = splayTo(val);
+    if (n == nullptr) {
+      return end();
+    }
+    // а здесь следующий нужен, если n не больше val
+    return larger(val, cast(n)->val1) ? n : n->next();
   }
   bool equal(const Type& val1, const Type& val2) const {
     return compare(val1, val2) == 0;
   }
+  // перестраивает дерево в идеально сбалансированное и запрещает поиску
+  // его менять
+  void freeze() {
+    std::vector<Node*> nodes;
+    nodes.reserve(count);
+    for (Node* n = begin(); n != end(); n = n->next()) {
+      nodes.push_back(n);
+    }
+    assign(nodes);
+    frozen = true;
+  }
+  // собирает из узлов, уже упорядоченных по ключу, сбалансированное дерево;
+  // старое содержимое дерева забывается
+  void assign(std::vector<Node*>& nodes) noexcept {
+    end_node.l = build(nodes.data(), nodes.data() + nodes.size(), &end_node);
+    count = max_count = nodes.size();
+  }
+  void unfreeze() noexcept {
+    frozen = false;
+  }
+  // Вынимает узлы [first, last) одним поддеревом: split по first, split
+  // остатка по last, и то, что меньше first, подвешивается к last слева.
+  // Вынутые узлы по одному, по возрастанию, отдаются f.
+  template <typename F>
+  void cut(Node* first, Node* last, F&& f) noexcept {
+    if (first == last) {
+      return;
+    }
+    splay(first);
+    Node* smaller = first->l;
+    first->l = nullptr;
+    Node* sub = first;
+    if (last == end()) {
+      end_node.l = smaller;
+      linkEndNode();
+    } else {
+      splay(last);
+      sub = last->l;
+      last->l = smaller;
+      if (smaller != nullptr) {
+        smaller->p = last;
+      }
+    }
+    dismantle(sub, [&](Node* n) {
+      count--;
+      f(n);
+    });
+  }
+  // Разбирает поддерево за линейное время без рекурсии: левый ребенок
+  // поворотом поднимается наверх, а узел без левого ребенка отдается f.
+  // Ссылки на родителей не используются, f может сразу освобождать узел.
+  template <typename F>
+  static void dismantle(Node* n, F&& f) noexcept {
+    while (n != nullptr) {
+      if (Node* l = n->l; l != nullptr) {
+        n->l = l->r;
+        l->r = n;
+        n = l;
+      } else {
+        Node* r = n->r;
+        f(n);
+        n = r;
+      }
+    }
+  }
+  // Оставляет только узлы, для которых keep вернул true, и собирает из них
+  // сбалансированное дерево за линейное время без выделения памяти.
+  // Отвергнутые узлы keep может сразу освобождать.
+  template <typename F>
+  void filter(F&& keep) noexcept {
+    Node head;
+    Node* tail = &head;
+    std::size_t kept = 0;
+    dismantle(end_node.l, [&](Node* n) {
+      if (keep(n)) {
+        tail->r = n;
+        tail = n;
+        kept++;
+      }
+    });
+    tail->r = nullptr;
+    Node* list = head.r;
+    end_node.l = buildFromList(list, kept, &end_node);
+    count = max_count = kept;
+  }
+  // забывает все узлы, не трогая их самих
+  void reset() noexcept {
+    end_node.l = nullptr;
+    count = max_count = 0;
+  }
   void swap(map& other) {
     std::swap(end_node.l, other.end_node.l);
+    std::swap(count, other.count);
+    std::swap(max_count, other.max_count);
+    std::swap(frozen, other.frozen);
     if (end_node.l != nullptr) {
       end_node.l->p = &end_node;
     }
@@ -207,7 +418,8 @@ private:
   Compare const& getComparator() const noexcept {
     return static_cast<Compare const&>(*this);
   }
-  int compare(const Type& l, const Type& r) const {
+  template <typename A, typename B>
+  int compare(const A& l, const B& r) const {
     if (getComparator()(l, r))
       return 1;
     if (!getComparator()(r, l))
@@ -217,13 +429,15 @@ private:
   int compare(Node* l, Node* r) const {
     return compare(cast(l)->val1, cast(r)->val1);
   }
-  bool larger(const Type& l, const Type& r) const {
+  template <typename A, typename B>
+  bool larger(const A& l, const B& r) const {
     return getComparator()(l, r);
   }
   bool larger(Node* l, Node* r) const {
     return larger(cast(l)->val1, cast(r)->val1);
   }
-  bool less(const Type& l, const Type& r) const {
+  template <typename A, typename B>
+  bool less(const A& l, const B& r) const {
     return getComparator()(r, l);
   }
   bool less(Node* l, Node* r) const {
@@ -300,37 +514,226 @@ private:
     end_node.l->p = &end_node;
     return end_node.l;
   }
-  Node* exists(Node* p, const Type& x) const {
-    if (p == nullptr || p == end())
-      return end();
-    if (less(cast(p)->val1, x)) {
-      return exists(p->l, x);
-    } else if (larger(cast(p)->val1, x)) {
-      return exists(p->r, x);
+  // узел с ключом val, а если его нет -- последний узел на пути поиска,
+  // то есть сосед val по порядку; nullptr для пустого дерева
+  template <typename K>
+  Node* locate(const K& val) const {
+    return frozen ? descend(val) : splayTo(val);
+  }
+  // lower/upper bound без перестройки, за один спуск: ответ -- последний
+  // узел, от которого пошли налево
+  template <bool Upper, typename K>
+  Node* bound(const K& val) const {
+    Node* res = end();
+    for (Node* n = end_node.l; n != nullptr;) {
+      if (Upper ? larger(val, cast(n)->val1) : !larger(cast(n)->val1, val)) {
+        res = n;
+        n = n->l;
+      } else {
+        n = n->r;
+      }
+    }
+    return res;
+  }
+  template <typename K>
+  Node* descend(const K& val) const {
+    Node* n = end_node.l;
+    while (n != nullptr) {
+      int cmp = compare(val, cast(n)->val1);
+      Node* next = cmp > 0 ? n->l : n->r;
+      if (cmp == 0 || next == nullptr) {
+        break;
+      }
+      n = next;
+    }
+    return n;
+  }
+  // top-down splay: поиск за один проход сверху вниз, по дороге дерево
+  // разбирается на узлы меньше val (копятся справа от head.r) и больше val
+  // (слева от head.l), а найденный узел становится корнем над ними
+  template <typename K>
+  Node* splayTo(const K& val) const {
+    Node* t = end_node.l;
+    if (t == nullptr) {
+      return nullptr;
+    }
+    Node head;
+    Node* L = &head;
+    Node* R = &head;
+    auto assemble = [&]() noexcept {
+      L->r = t->l;
+      if (t->l != nullptr) {
+        t->l->p = L;
+      }
+      R->l = t->r;
+      if (t->r != nullptr) {
+        t->r->p = R;
+      }
+      t->l = head.r;
+      if (t->l != nullptr) {
+        t->l->p = t;
+      }
+      t->r = head.l;
+      if (t->r != nullptr) {
+        t->r->p = t;
+      }
+      t->p = &end_node;
+      end_node.l = t;
+    };
+    // компаратор может бросить, тогда собираем то, что успели разобрать
+    try {
+      while (true) {
+        int cmp = compare(val, cast(t)->val1);
+        if (cmp > 0) {
+          if (t->l == nullptr) {
+            break;
+          }
+          if (compare(val, cast(t->l)->val1) > 0) {
+            Node* y = t->l;
+            t->l = y->r;
+            if (t->l != nullptr) {
+              t->l->p = t;
+            }
+            y->r = t;
+            t->p = y;
+            t = y;
+            if (t->l == nullptr) {
+              break;
+            }
+          }
+          R->l = t;
+          t->p = R;
+          R = t;
+          t = t->l;
+        } else if (cmp < 0) {
+          if (t->r == nullptr) {
+            break;
+          }
+          if (compare(val, cast(t->r)->val1) < 0) {
+            Node* y = t->r;
+            t->r = y->l;
+            if (t->r != nullptr) {
+              t->r->p = t;
+            }
+            y->l = t;
+            t->p = y;
+            t = y;
+            if (t->r == nullptr) {
+              break;
+            }
+          }
+          L->r = t;
+          t->p = L;
+          L = t;
+          t = t->r;
+        } else {
+          break;
+        }
+      }
+    } catch (...) {
+      assemble();
+      throw;
+    }
+    assemble();
+    return t;
+  }
+  // scapegoat: идем вверх от слишком глубокого узла до первого предка, у
+  // которого один ребенок тяжелее 2/3 всего поддерева, и перестраиваем его
+  void rebalanceAbove(Node* n) noexcept {
+    std::size_t size = 1;
+    for (Node* par = n->p; par != &end_node; n = par, par = par->p) {
+      std::size_t total = size + 1 + subtreeSize(par->l == n ? par->r : par->l);
+      if (3 * size > 2 * total) {
+        rebuild(par, total);
+        return;
+      }
+      size = total;
     }
-    return p;
   }
-  Node* lower(Node* p, const Type& val) const {
-    if (p == nullptr || p == end())
-      return end();
-    if (larger(cast(p)->val1, val)) {
-      return lower(p->r, val);
+  static std::size_t subtreeSize(Node* n) noexcept {
+    if (n == nullptr) {
+      return 0;
+    }
+    std::size_t size = 1;
+    for (Node *cur = n->leftmost(), *last = n->rightmost(); cur != last;
+         cur = cur->next()) {
+      size++;
     }
-    Node* n = lower(p->l, val);
-    if (n != end())
-      return n;
-    return p;
+    return size;
   }
-  Node* upper(Node* p, const Type& val) const {
-    if (p == nullptr || p == end())
-      return end();
-    if (less(cast(p)->val1, val)) {
-      return lower(p->l, val);
+  // перестраивает поддерево sub из size узлов в идеально сбалансированное;
+  // если на это не хватило памяти, дерево просто остается глубже
+  void rebuild(Node* sub, std::size_t size) noexcept {
+    if (sub == nullptr) {
+      return;
+    }
+    try {
+      std::vector<Node*> nodes;
+      nodes.reserve(size);
+      Node* cur = sub->leftmost();
+      for (std::size_t i = 0; i < size; i++, cur = cur->next()) {
+        nodes.push_back(cur);
+      }
+      Node* par = sub->p;
+      Node* root = build(nodes.data(), nodes.data() + size, par);
+      (par->l == sub ? par->l : par->r) = root;
+    } catch (std::bad_alloc const&) {
+    }
+  }
+  // обычное удаление из двоичного дерева, без поворотов: узел с двумя
+  // детьми заменяется следующим за ним
+  void removeInPlace(Node* n) noexcept {
+    Node* par = n->p;
+    Node* repl;
+    if (n->l == nullptr) {
+      repl = n->r;
+    } else if (n->r == nullptr) {
+      repl = n->l;
+    } else {
+      repl = n->r->leftmost();
+      if (repl->p != n) {
+        repl->p->l = repl->r;
+        if (repl->r != nullptr) {
+          repl->r->p = repl->p;
+        }
+        repl->r = n->r;
+        n->r->p = repl;
+      }
+      repl->l = n->l;
+      n->l->p = repl;
+    }
+    (par->l == n ? par->l : par->r) = repl;
+    if (repl != nullptr) {
+      repl->p = par;
+    }
+  }
+  // то же, что build, но из упорядоченного списка по r, который съедается
+  static Node* buildFromList(Node*& list, std::size_t size,
+                             Node* parent) noexcept {
+    if (size == 0) {
+      return nullptr;
+    }
+    Node* left = buildFromList(list, size / 2, nullptr);
+    Node* n = list;
+    list = list->r;
+    n->p = parent;
+    n->l = left;
+    if (left != nullptr) {
+      left->p = n;
+    }
+    n->r = buildFromList(list, size - size / 2 - 1, n);
+    return n;
+  }
+  static Node* build(Node** first, Node** last, Node* parent) noexcept {
+    if (first == last) {
+      return nullptr;
     }
-    Node* n = lower(p->r, val);
-    if (n != end())
-      return n;
-    return p;
+    Node** mid = first + (last - first) / 2;
+    Node* n = *mid;
+    n->p = parent;
+    n->l = build(first, mid, n);
+    n->r = build(mid + 1, last, n);
+    return n;
   }
 
   // непосредственно конвертация ноды, дабы иметь доступ к данным
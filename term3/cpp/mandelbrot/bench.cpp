@@ -0,0 +1,278 @@
+#include "palette.h"
+#include "render.h"
+#include "scheduler.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// рендер без окна: считает вид заданного размера теми же тайлами и тем же
+// планировщиком, что и окно, пишет картинку в PPM и печатает скорость
+
+namespace {
+    constexpr int BLOCK = 128;
+
+    struct View {
+        const char *name;
+        // центр строкой, чтобы не терять знаки на глубоком зуме
+        const char *x, *y;
+        // ширина вида по вещественной оси
+        double extent;
+    };
+
+    const View VIEWS[] = {
+            {"full",     "-0.5",                                  "0",                                    3.},
+            {"seahorse", "-0.7453",                               "0.1127",                               6e-3},
+            {"elephant", "0.2822",                                "0.01",                                 2e-2},
+            {"spiral",   "-0.761574",                             "-0.0847596",                           2e-3},
+            {"interior", "-0.2",                                  "0",                                    .5},
+            // центр между соседними double, без опорной орбиты картинка рассыпается
+            {"deep",     "-1.749900000000000000012",              "0.000000000000000000045",              1e-14},
+    };
+
+    struct Options {
+        View view = VIEWS[0];
+        int width = 1920, height = 1080;
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        int repeat = 1;
+        // уровни детализации тайла: как в окне, сначала грубые, потом точнее
+        int levels = 1;
+        // пока считается, крутить палитру и перекрашивать готовые уровни,
+        // как окно под нажатыми ',' и '.'
+        bool cycle = false;
+        bool all = false;
+        std::string out;
+    };
+
+    struct Result {
+        double seconds;
+        // перекраска всех тайлов другой палитрой, без пересчета
+        double recolor;
+        long long iterations;
+        // точки считаются целыми тайлами на всех уровнях, включая вылезшие за край
+        double tiled;
+        Image image;
+    };
+
+    Result run(const Options &opt, const View &view) {
+        DComplex c(DDouble::parse(view.x), DDouble::parse(view.y));
+        double pixel = view.extent / opt.width;
+        std::shared_ptr<const ReferenceOrbit> ref;
+        DComplex anchor;
+        if (RenderFrame::precision(pixel) == RenderFrame::DEEP) {
+            ref = std::make_shared<ReferenceOrbit>(c, kernel::MAX_STEPS);
+            anchor = c;
+        }
+        // левый верхний угол относительно начала отсчета сетки
+        std::complex<double> origin = (c - anchor) - std::complex<double>(opt.width, opt.height) * (pixel / 2);
+        std::complex<double> size(BLOCK * pixel, BLOCK * pixel);
+
+        int tx = (opt.width + BLOCK - 1) / BLOCK, ty = (opt.height + BLOCK - 1) / BLOCK;
+        std::vector<std::shared_ptr<RenderFrame>> frames;
+        for (int y = 0; y < ty; y++) {
+            for (int x = 0; x < tx; x++) {
+                auto offset = origin + std::complex<double>(x, y) * (BLOCK * pixel);
+                frames.push_back(std::make_shared<RenderFrame>(
+                        opt.levels, std::pair<double, double>{offset.real(), offset.imag()},
+                        std::pair<double, double>{size.real(), size.imag()},
+                        std::pair<double, double>{BLOCK, BLOCK}, BLOCK, BLOCK, ref));
+            }
+        }
+
+        long long stepsBefore = RenderFrame::stats.steps.load();
+        auto &saved = kernel::stats;
+        long long savedBefore = saved.cardioid.load() + saved.bulb.load() + saved.periodicity.load();
+
+        TileScheduler scheduler(opt.threads, opt.levels);
+        std::atomic<size_t> left = frames.size();
+        auto start = std::chrono::steady_clock::now();
+        for (auto &frame: frames) {
+            scheduler.push({frame, opt.levels - 1, {}});
+        }
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < opt.threads; i++) {
+            workers.emplace_back([&, i] {
+                TileScheduler::Task task;
+                while (scheduler.pop(i, task)) {
+                    task.frame->generateFrame(task.step);
+                    if (task.step > 0) {
+                        task.step--;
+                        scheduler.push(std::move(task));
+                    } else if (left.fetch_sub(1) == 1) {
+                        scheduler.stop();
+                    }
+                }
+            });
+        }
+        while (opt.cycle && left.load() > 0) {
+            palette::shift(.01f);
+            for (auto &frame: frames) {
+                frame->recolor();
+            }
+        }
+        for (auto &th: workers) {
+            th.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        auto recolorStart = std::chrono::steady_clock::now();
+        palette::shift(0);
+        for (auto &frame: frames) {
+            frame->recolor();
+        }
+        double recolor = std::chrono::duration<double>(std::chrono::steady_clock::now() - recolorStart).count();
+
+        // итерации -- только реально выполненные: шаги посчитанных точек без
+        // сэкономленных проверками внутренних точек, залитые не в счет
+        long long iterations = RenderFrame::stats.steps.load() - stepsBefore -
+                               (saved.cardioid.load() + saved.bulb.load() + saved.periodicity.load() - savedBefore);
+        double tiled = 0;
+        for (int k = 0, size = BLOCK; k < opt.levels; k++, size /= 4) tiled += (double) frames.size() * size * size;
+        Result res{seconds, recolor, iterations, tiled, Image(opt.width, opt.height)};
+        for (int y = 0; y < ty; y++) {
+            for (int x = 0; x < tx; x++) {
+                RenderFrame &frame = *frames[y * tx + x];
+                const Image &tile = *frame.getImage();
+                int w = std::min(BLOCK, opt.width - x * BLOCK), h = std::min(BLOCK, opt.height - y * BLOCK);
+                for (int i = 0; i < h; i++) {
+                    std::memcpy(res.image.bits() + (y * BLOCK + i) * res.image.bytesPerLine() + x * BLOCK * 3,
+                                tile.constBits() + i * tile.bytesPerLine(), w * 3);
+                }
+            }
+        }
+        return res;
+    }
+
+    bool writePpm(const std::string &path, const Image &image) {
+        std::ofstream out(path, std::ios::binary);
+        out << "P6\n" << image.width() << ' ' << image.height() << "\n255\n";
+        out.write(reinterpret_cast<const char *>(image.constBits()), (std::streamsize) image.sizeInBytes());
+        return (bool) out;
+    }
+
+    void report(const Options &opt, const View &view) {
+        Result best{};
+        long long evaluated = 0, filled = 0;
+        for (int k = 0; k < opt.repeat; k++) {
+            RenderFrame::stats.evaluated = RenderFrame::stats.filled = 0;
+            Result cur = run(opt, view);
+            if (k == 0 || cur.seconds < best.seconds) best = std::move(cur);
+            evaluated = RenderFrame::stats.evaluated.load();
+            filled = RenderFrame::stats.filled.load();
+        }
+        double pixels = (double) opt.width * opt.height;
+        const char *precision[] = {"float", "double", "deep"};
+        std::printf("%-9s %-6s %8.1f ms %8.2f Mpix/s %8.3f Giter/s  evaluated %5.1f%%  filled %5.1f%%  "
+                    "recolor %5.1f ms\n", view.name, precision[RenderFrame::precision(view.extent / opt.width)],
+                    best.seconds * 1e3, pixels / best.seconds / 1e6, best.iterations / best.seconds / 1e9,
+                    100. * evaluated / best.tiled, 100. * filled / best.tiled, best.recolor * 1e3);
+        if (!opt.out.empty()) {
+            std::string path = opt.out;
+            if (opt.all) {
+                size_t dot = path.rfind('.');
+                path.insert(dot == std::string::npos ? path.size() : dot, std::string("_") + view.name);
+            }
+            if (!writePpm(path, best.image)) std::cerr << "can't write " << path << '\n';
+        }
+    }
+
+    void usage(const char *name) {
+        std::cerr << "usage: " << name << " [--view NAME | --center X Y --extent E] [--all]\n"
+                  << "       [--size WxH] [--threads N] [--mode pixels|borders] [--repeat K] [--out file.ppm]\n"
+                  << "       [--smooth on|off] [--palette NAME] [--float on|off] [--levels 1-4] [--cycle]\n"
+                  << "       [--inherit on|off]\n"
+                  << "views:";
+        for (auto &view: VIEWS) std::cerr << ' ' << view.name;
+        std::cerr << "\npalettes:";
+        for (int i = 0; i < palette::count(); i++) std::cerr << ' ' << palette::name(i);
+        std::cerr << '\n';
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    std::string cx, cy;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool more = i + 1 < argc;
+        if (arg == "--view" && more) {
+            std::string name = argv[++i];
+            bool found = false;
+            for (auto &view: VIEWS) {
+                if (name == view.name) {
+                    opt.view = view;
+                    found = true;
+                }
+            }
+            if (!found) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--center" && i + 2 < argc) {
+            cx = argv[++i];
+            cy = argv[++i];
+            opt.view = {"custom", cx.c_str(), cy.c_str(), opt.view.extent};
+        } else if (arg == "--extent" && more) {
+            opt.view.extent = std::stod(argv[++i]);
+        } else if (arg == "--size" && more) {
+            if (std::sscanf(argv[++i], "%dx%d", &opt.width, &opt.height) != 2 || opt.width <= 0 || opt.height <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--threads" && more) {
+            opt.threads = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--mode" && more) {
+            std::string mode = argv[++i];
+            RenderFrame::mode.store(mode == "borders" ? RenderFrame::BORDERS : RenderFrame::PIXELS);
+        } else if (arg == "--float" && more) {
+            RenderFrame::allowFloat.store(std::string(argv[++i]) != "off");
+        } else if (arg == "--inherit" && more) {
+            RenderFrame::inheritUniform.store(std::string(argv[++i]) != "off");
+        } else if (arg == "--smooth" && more) {
+            RenderFrame::smooth.store(std::string(argv[++i]) != "off");
+        } else if (arg == "--palette" && more) {
+            std::string name = argv[++i];
+            int found = -1;
+            for (int k = 0; k < palette::count(); k++) {
+                if (name == palette::name(k)) found = k;
+            }
+            if (found < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            palette::select(found);
+        } else if (arg == "--repeat" && more) {
+            opt.repeat = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--out" && more) {
+            opt.out = argv[++i];
+        } else if (arg == "--levels" && more) {
+            opt.levels = std::stoi(argv[++i]);
+            // меньше 2x2 точек тайл в 128 точек не делится
+            if (opt.levels < 1 || opt.levels > 4) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--cycle") {
+            opt.cycle = true;
+        } else if (arg == "--all") {
+            opt.all = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::printf("%dx%d, %zu threads, kernel %s, mode %s, smooth %s, palette %s\n", opt.width, opt.height,
+                opt.threads, kernel::rowName(kernel::selectRow()),
+                RenderFrame::mode.load() == RenderFrame::BORDERS ? "borders" : "pixels",
+                RenderFrame::smooth.load() ? "on" : "off", palette::name(palette::current.load()));
+    if (opt.all) {
+        for (auto &view: VIEWS) report(opt, view);
+    } else {
+        report(opt, opt.view);
+    }
+    return 0;
+}
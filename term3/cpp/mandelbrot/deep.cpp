@@ -0,0 +1,151 @@
+#include "deep.h"
+#include "kernel.h"
+#include <cctype>
+#include <cmath>
+
+namespace {
+    DDouble twoSum(double a, double b) {
+        double s = a + b;
+        double bb = s - a;
+        return {s, (a - (s - bb)) + (b - bb)};
+    }
+
+    DDouble quickTwoSum(double a, double b) {
+        double s = a + b;
+        return {s, b - (s - a)};
+    }
+}
+
+DDouble operator+(DDouble a, DDouble b) {
+    DDouble s = twoSum(a.hi, b.hi);
+    DDouble t = twoSum(a.lo, b.lo);
+    s = quickTwoSum(s.hi, s.lo + t.hi);
+    return quickTwoSum(s.hi, s.lo + t.lo);
+}
+
+DDouble operator-(DDouble a, DDouble b) {
+    return a + (-b);
+}
+
+DDouble operator*(DDouble a, DDouble b) {
+    double p = a.hi * b.hi;
+    double e = std::fma(a.hi, b.hi, -p);
+    e += a.hi * b.lo + a.lo * b.hi;
+    return quickTwoSum(p, e);
+}
+
+DDouble operator/(DDouble a, DDouble b) {
+    double q1 = a.hi / b.hi;
+    DDouble r = a - b * q1;
+    double q2 = r.hi / b.hi;
+    r = r - b * q2;
+    double q3 = r.hi / b.hi;
+    return quickTwoSum(q1, q2) + q3;
+}
+
+DDouble DDouble::parse(const std::string &str) {
+    DDouble res;
+    size_t i = 0;
+    bool negative = false;
+    if (i < str.size() && (str[i] == '-' || str[i] == '+')) negative = str[i++] == '-';
+
+    int exp = 0;
+    bool point = false;
+    for (; i < str.size(); i++) {
+        if (str[i] == '.') {
+            point = true;
+        } else if (std::isdigit((unsigned char) str[i])) {
+            res = res * 10. + (double) (str[i] - '0');
+            if (point) exp--;
+        } else {
+            break;
+        }
+    }
+    if (i < str.size() && (str[i] == 'e' || str[i] == 'E')) {
+        exp += std::stoi(str.substr(i + 1));
+    }
+
+    DDouble scale = 1.;
+    for (int k = 0; k < std::abs(exp); k++) scale = scale * 10.;
+    res = exp < 0 ? res / scale : res * scale;
+    return negative ? -res : res;
+}
+
+ReferenceOrbit::ReferenceOrbit(DComplex c, int maxSteps) : c(c) {
+    DDouble zx, zy;
+    std::complex<double> A = 0, B = 0, C = 0;
+
+    for (int step = 0; step <= maxSteps; step++) {
+        std::complex<double> cur((double) zx, (double) zy);
+        z.push_back(cur);
+        a.push_back(A);
+        b.push_back(B);
+        cc.push_back(C);
+        if (std::norm(cur) >= 4.) break;
+
+        C = 2. * cur * C + 2. * A * B;
+        B = 2. * cur * B + A * A;
+        A = 2. * cur * A + 1.;
+
+        DDouble x2 = zx * zx, y2 = zy * zy;
+        zy = (zx + zx) * zy + c.im;
+        zx = x2 - y2 + c.re;
+    }
+}
+
+int ReferenceOrbit::skip(double radius) const {
+    // ряд годится, пока кубический член пренебрежимо мал по сравнению с линейным
+    int n = 0;
+    for (int i = 1; i + 1 < (int) z.size(); i++) {
+        double lin = std::abs(a[i]) * radius;
+        double cube = std::abs(cc[i]) * radius * radius * radius;
+        if (!std::isfinite(lin) || !std::isfinite(cube) || cube > lin * 1e-12) break;
+        n = i;
+    }
+    return n;
+}
+
+int ReferenceOrbit::iterate(std::complex<double> dc, int skip, double &norm) const {
+    std::complex<double> dz = (a[skip] + (b[skip] + cc[skip] * dc) * dc) * dc;
+    double dx = dz.real(), dy = dz.imag();
+    int m = skip;
+    int last = (int) z.size() - 1;
+
+    for (int step = skip; step < kernel::MAX_STEPS; step++) {
+        double zx = z[m].real() + dx, zy = z[m].imag() + dy;
+        norm = zx * zx + zy * zy;
+        if (norm >= 4.) return step;
+
+        // когда точка подходит к нулю ближе опорной орбиты или орбита
+        // кончилась, отклонение теряет точность -- переезжаем в начало орбиты
+        if (norm < dx * dx + dy * dy || m == last) {
+            dx = zx;
+            dy = zy;
+            m = 0;
+        }
+
+        double rx = z[m].real(), ry = z[m].imag();
+        double nx = 2 * (rx * dx - ry * dy) + (dx * dx - dy * dy) + dc.real();
+        double ny = 2 * (rx * dy + ry * dx) + 2 * dx * dy + dc.imag();
+        dx = nx;
+        dy = ny;
+        m++;
+    }
+    return kernel::MAX_STEPS;
+}
+
+void ReferenceOrbit::row(double x0, double dx, double y, int n, int skip, int *steps, float *smooth) const {
+    double norm = 0;
+    for (int j = 0; j < n; j++) {
+        steps[j] = iterate({x0 + j * dx, y}, skip, norm);
+        if (smooth) smooth[j] = kernel::smoothSteps(steps[j], norm);
+    }
+}
+
+void ReferenceOrbit::points(const double *x, const double *y, int n, int skip, int *steps, float *smooth) const {
+    double norm = 0;
+    for (int j = 0; j < n; j++) {
+        steps[j] = iterate({x[j], y[j]}, skip, norm);
+        if (smooth) smooth[j] = kernel::smoothSteps(steps[j], norm);
+    }
+}
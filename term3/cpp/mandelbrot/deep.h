@@ -0,0 +1,103 @@
+#ifndef DEEP_H
+#define DEEP_H
+
+#include <complex>
+#include <string>
+#include <vector>
+
+// число как невычисленная сумма двух double, дает ~106 бит мантиссы;
+// этого хватает на зум примерно до 1e-30
+struct DDouble {
+    double hi = 0, lo = 0;
+
+    DDouble() = default;
+
+    DDouble(double x) : hi(x) {}
+
+    DDouble(double hi, double lo) : hi(hi), lo(lo) {}
+
+    explicit operator double() const {
+        return hi + lo;
+    }
+
+    friend DDouble operator+(DDouble a, DDouble b);
+
+    friend DDouble operator-(DDouble a, DDouble b);
+
+    friend DDouble operator*(DDouble a, DDouble b);
+
+    friend DDouble operator/(DDouble a, DDouble b);
+
+    // десятичная запись вида -1.25e-3, без потери знаков после 16-го
+    static DDouble parse(const std::string &str);
+
+    DDouble operator-() const {
+        return {-hi, -lo};
+    }
+
+    DDouble &operator+=(DDouble b) {
+        return *this = *this + b;
+    }
+
+    DDouble &operator-=(DDouble b) {
+        return *this = *this - b;
+    }
+};
+
+struct DComplex {
+    DDouble re, im;
+
+    DComplex() = default;
+
+    DComplex(DDouble re, DDouble im) : re(re), im(im) {}
+
+    DComplex(std::complex<double> z) : re(z.real()), im(z.imag()) {}
+
+    DComplex operator+(std::complex<double> z) const {
+        return {re + z.real(), im + z.imag()};
+    }
+
+    DComplex operator-(std::complex<double> z) const {
+        return {re - z.real(), im - z.imag()};
+    }
+
+    // разность близких точек, она уже помещается в double
+    std::complex<double> operator-(const DComplex &z) const {
+        return {(double) (re - z.re), (double) (im - z.im)};
+    }
+};
+
+// одна опорная орбита Z_n, посчитанная с повышенной точностью, пиксели
+// считаются как отклонения dz от нее в обычных double:
+// dz' = 2 Z dz + dz^2 + dc
+class ReferenceOrbit {
+    DComplex c;
+    std::vector<std::complex<double>> z;
+    // коэффициенты ряда dz_n ~ A_n dc + B_n dc^2 + C_n dc^3
+    std::vector<std::complex<double>> a, b, cc;
+
+public:
+    ReferenceOrbit(DComplex c, int maxSteps);
+
+    const DComplex &center() const {
+        return c;
+    }
+
+    size_t size() const {
+        return z.size();
+    }
+
+    // сколько первых итераций можно пропустить рядом для всех dc, |dc| <= radius
+    int skip(double radius) const;
+
+    // то же, что kernel::RowFunc, но точка строки задается отклонением от c
+    void row(double x0, double dx, double y, int n, int skip, int *steps, float *smooth) const;
+
+    // то же для произвольных точек, как kernel::PointsFunc
+    void points(const double *x, const double *y, int n, int skip, int *steps, float *smooth) const;
+
+private:
+    int iterate(std::complex<double> dc, int skip, double &norm) const;
+};
+
+#endif // DEEP_H
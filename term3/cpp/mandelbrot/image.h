@@ -0,0 +1,43 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <cstddef>
+#include <vector>
+
+// картинка RGB888 без Qt, чтобы ядро рендера собиралось и без него;
+// окно оборачивает буфер в QImage без копирования
+class Image {
+    std::vector<unsigned char> data;
+    int w = 0, h = 0;
+
+public:
+    Image() = default;
+
+    Image(int w, int h) : data((size_t) w * h * 3), w(w), h(h) {}
+
+    unsigned char *bits() {
+        return data.data();
+    }
+
+    const unsigned char *constBits() const {
+        return data.data();
+    }
+
+    int width() const {
+        return w;
+    }
+
+    int height() const {
+        return h;
+    }
+
+    size_t bytesPerLine() const {
+        return (size_t) w * 3;
+    }
+
+    size_t sizeInBytes() const {
+        return data.size();
+    }
+};
+
+#endif // IMAGE_H
@@ -0,0 +1,520 @@
+#include "kernel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNEL_X86
+#include <immintrin.h>
+#endif
+
+kernel::Options kernel::options;
+kernel::Stats kernel::stats;
+
+namespace {
+    // насколько близко орбита должна вернуться, чтобы считать ее циклом
+    constexpr double PERIOD_EPS = 1e-13;
+    // у float соседние числа около 1 отстоят на 6e-8
+    constexpr float PERIOD_EPS_FLOAT = 1e-6f;
+
+    bool inCardioid(double x, double y) {
+        double xq = x - .25;
+        double q = xq * xq + y * y;
+        return q * (q + xq) <= .25 * y * y;
+    }
+
+    bool inBulb(double x, double y) {
+        return (x + 1) * (x + 1) + y * y <= 1. / 16;
+    }
+
+    // log2 по показателю и многочлену от мантиссы, ошибка ~1e-4 -- для цвета
+    // хватает, а std::log2 на каждую точку заметно тормозит простые виды
+    float fastLog2(float x) {
+        unsigned bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        float e = (float) ((int) (bits >> 23) - 127);
+        bits = (bits & 0x7fffff) | 0x3f800000;
+        float m;
+        std::memcpy(&m, &bits, sizeof(m));
+        float ln = -1.7417939f + (2.8212026f + (-1.4699568f + (0.44717955f - 0.056570851f * m) * m) * m) * m;
+        return e + ln * 1.44269504f;
+    }
+
+    // встраивается прямо в векторные циклы: вызов обычной функции из них
+    // с грязными верхними половинами регистров стоит дороже самого расчета
+    inline float smoothValue(int steps, double norm) {
+        if (steps == kernel::MAX_STEPS) return kernel::MAX_STEPS;
+        return (float) steps + 1.f - fastLog2(.5f * fastLog2((float) norm));
+    }
+}
+
+kernel::Saved::~Saved() {
+    if (cardioid) stats.cardioid.fetch_add(cardioid, std::memory_order_relaxed);
+    if (bulb) stats.bulb.fetch_add(bulb, std::memory_order_relaxed);
+    if (periodicity) stats.periodicity.fetch_add(periodicity, std::memory_order_relaxed);
+}
+
+int kernel::iterate(double x, double y, Saved &saved, double &norm) {
+    if (options.cardioid.load(std::memory_order_relaxed)) {
+        if (inCardioid(x, y)) {
+            saved.cardioid += MAX_STEPS;
+            return MAX_STEPS;
+        }
+        if (inBulb(x, y)) {
+            saved.bulb += MAX_STEPS;
+            return MAX_STEPS;
+        }
+    }
+    bool periodic = options.periodicity.load(std::memory_order_relaxed);
+
+    double zx = 0, zy = 0, sx = 0, sy = 0;
+    int check = 1;
+
+    int step = 0;
+    for (; step < MAX_STEPS; step++) {
+        double x2 = zx * zx, y2 = zy * zy;
+        norm = x2 + y2;
+        if (norm >= 4.) break;
+        zy = 2 * zx * zy + y;
+        zx = x2 - y2 + x;
+
+        if (periodic) {
+            if (std::abs(zx - sx) < PERIOD_EPS && std::abs(zy - sy) < PERIOD_EPS) {
+                saved.periodicity += MAX_STEPS - step - 1;
+                return MAX_STEPS;
+            }
+            // точку сравнения обновляем на степенях двойки
+            if (step == check) {
+                sx = zx;
+                sy = zy;
+                check <<= 1;
+            }
+        }
+    }
+    return step;
+}
+
+float kernel::smoothSteps(int steps, double norm) {
+    return smoothValue(steps, norm);
+}
+
+void kernel::pointsScalar(const double *x, const double *y, int n, int *steps, float *smooth) {
+    Saved saved;
+    double norm = 0;
+    for (int j = 0; j < n; j++) {
+        steps[j] = iterate(x[j], y[j], saved, norm);
+        if (smooth) smooth[j] = smoothValue(steps[j], norm);
+    }
+}
+
+namespace {
+    // строка раскладывается в точки кусками на стеке
+    template<kernel::PointsFunc points>
+    void row(double x0, double dx, double y, int n, int *steps, float *smooth) {
+        constexpr int CHUNK = 64;
+        double xs[CHUNK], ys[CHUNK];
+        for (int j = 0; j < n; j += CHUNK) {
+            int m = std::min(CHUNK, n - j);
+            for (int k = 0; k < m; k++) {
+                xs[k] = x0 + (j + k) * dx;
+                ys[k] = y;
+            }
+            points(xs, ys, m, steps + j, smooth ? smooth + j : nullptr);
+        }
+    }
+}
+
+void kernel::rowScalar(double x0, double dx, double y, int n, int *steps, float *smooth) {
+    row<pointsScalar>(x0, dx, y, n, steps, smooth);
+}
+
+void kernel::rowAvx2(double x0, double dx, double y, int n, int *steps, float *smooth) {
+    row<pointsAvx2>(x0, dx, y, n, steps, smooth);
+}
+
+void kernel::rowAvx512(double x0, double dx, double y, int n, int *steps, float *smooth) {
+    row<pointsAvx512>(x0, dx, y, n, steps, smooth);
+}
+
+void kernel::rowFloatAvx2(double x0, double dx, double y, int n, int *steps, float *smooth) {
+    row<pointsFloatAvx2>(x0, dx, y, n, steps, smooth);
+}
+
+void kernel::rowFloatAvx512(double x0, double dx, double y, int n, int *steps, float *smooth) {
+    row<pointsFloatAvx512>(x0, dx, y, n, steps, smooth);
+}
+
+#ifdef KERNEL_X86
+
+// все линии вектора итерируются вместе, вылетевшие линии просто перестают
+// увеличивать свой счетчик, цикл заканчивается, когда вылетели все.
+// Линии, попавшие в кардиоиду или зациклившиеся, сразу получают MAX_STEPS.
+// z вылетевших линий замораживается, чтобы после цикла взять норму для сглаживания.
+// Последний неполный вектор добивается линиями, вылетевшими с самого начала:
+// они ничего не стоят, а скалярный хвост стоил бы до 7 полных точек
+__attribute__((target("avx2,fma")))
+void kernel::pointsAvx2(const double *x, const double *y, int n, int *steps, float *smooth) {
+    const __m256d four = _mm256_set1_pd(4.);
+    const __m256d one = _mm256_set1_pd(1.);
+    const __m256d max = _mm256_set1_pd(MAX_STEPS);
+    const __m256d eps = _mm256_set1_pd(PERIOD_EPS);
+    const __m256d sign = _mm256_set1_pd(-0.);
+    const __m256d lane = _mm256_set_pd(3, 2, 1, 0);
+    bool cardioid = options.cardioid.load(std::memory_order_relaxed);
+    bool periodic = options.periodicity.load(std::memory_order_relaxed);
+    Saved saved;
+
+    for (int j = 0; j < n; j += 4) {
+        int m = std::min(4, n - j);
+        alignas(32) double px[4] = {}, py[4] = {};
+        std::copy(x + j, x + j + m, px);
+        std::copy(y + j, y + j + m, py);
+        __m256d cx = _mm256_load_pd(px), cy = _mm256_load_pd(py);
+        __m256d pad = _mm256_cmp_pd(lane, _mm256_set1_pd(m), _CMP_GE_OQ);
+        __m256d zx = _mm256_setzero_pd(), zy = _mm256_setzero_pd();
+        __m256d sx = zx, sy = zy, done = pad;
+
+        if (cardioid) {
+            __m256d xq = _mm256_sub_pd(cx, _mm256_set1_pd(.25));
+            __m256d q = _mm256_fmadd_pd(xq, xq, _mm256_mul_pd(cy, cy));
+            __m256d card = _mm256_andnot_pd(pad, _mm256_cmp_pd(_mm256_mul_pd(q, _mm256_add_pd(q, xq)),
+                                                               _mm256_mul_pd(_mm256_set1_pd(.25), _mm256_mul_pd(cy, cy)),
+                                                               _CMP_LE_OQ));
+            __m256d xb = _mm256_add_pd(cx, one);
+            __m256d bulb = _mm256_andnot_pd(_mm256_or_pd(card, pad),
+                                            _mm256_cmp_pd(_mm256_fmadd_pd(xb, xb, _mm256_mul_pd(cy, cy)),
+                                                          _mm256_set1_pd(1. / 16), _CMP_LE_OQ));
+            saved.cardioid += (long long) __builtin_popcount(_mm256_movemask_pd(card)) * MAX_STEPS;
+            saved.bulb += (long long) __builtin_popcount(_mm256_movemask_pd(bulb)) * MAX_STEPS;
+            done = _mm256_or_pd(done, _mm256_or_pd(card, bulb));
+        }
+        __m256d cnt = _mm256_and_pd(done, max);
+
+        int check = 1;
+        for (int step = 0; step < MAX_STEPS; step++) {
+            __m256d x2 = _mm256_mul_pd(zx, zx);
+            __m256d y2 = _mm256_mul_pd(zy, zy);
+            __m256d alive = _mm256_andnot_pd(done, _mm256_cmp_pd(_mm256_add_pd(x2, y2), four, _CMP_LT_OQ));
+            if (_mm256_movemask_pd(alive) == 0) break;
+            cnt = _mm256_add_pd(cnt, _mm256_and_pd(alive, one));
+            zy = _mm256_blendv_pd(zy, _mm256_fmadd_pd(_mm256_add_pd(zx, zx), zy, cy), alive);
+            zx = _mm256_blendv_pd(zx, _mm256_add_pd(_mm256_sub_pd(x2, y2), cx), alive);
+
+            if (periodic) {
+                __m256d ex = _mm256_andnot_pd(sign, _mm256_sub_pd(zx, sx));
+                __m256d ey = _mm256_andnot_pd(sign, _mm256_sub_pd(zy, sy));
+                __m256d cycle = _mm256_and_pd(alive, _mm256_and_pd(_mm256_cmp_pd(ex, eps, _CMP_LT_OQ),
+                                                                   _mm256_cmp_pd(ey, eps, _CMP_LT_OQ)));
+                int mask = _mm256_movemask_pd(cycle);
+                if (mask) {
+                    saved.periodicity += (long long) __builtin_popcount(mask) * (MAX_STEPS - step - 1);
+                    cnt = _mm256_blendv_pd(cnt, max, cycle);
+                    done = _mm256_or_pd(done, cycle);
+                }
+                if (step == check) {
+                    sx = zx;
+                    sy = zy;
+                    check <<= 1;
+                }
+            }
+        }
+        alignas(16) int out[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(out), _mm256_cvtpd_epi32(cnt));
+        std::copy(out, out + m, steps + j);
+        if (smooth) {
+            alignas(32) double norm[4];
+            _mm256_store_pd(norm, _mm256_fmadd_pd(zx, zx, _mm256_mul_pd(zy, zy)));
+            for (int k = 0; k < m; k++) smooth[j + k] = smoothValue(out[k], norm[k]);
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+void kernel::pointsAvx512(const double *x, const double *y, int n, int *steps, float *smooth) {
+    const __m512d four = _mm512_set1_pd(4.);
+    const __m512d one = _mm512_set1_pd(1.);
+    const __m512d max = _mm512_set1_pd(MAX_STEPS);
+    const __m512d eps = _mm512_set1_pd(PERIOD_EPS);
+    bool cardioid = options.cardioid.load(std::memory_order_relaxed);
+    bool periodic = options.periodicity.load(std::memory_order_relaxed);
+    Saved saved;
+
+    for (int j = 0; j < n; j += 8) {
+        int m = std::min(8, n - j);
+        __mmask8 valid = (__mmask8) ((1u << m) - 1);
+        __m512d cx = _mm512_maskz_loadu_pd(valid, x + j), cy = _mm512_maskz_loadu_pd(valid, y + j);
+        __m512d zx = _mm512_setzero_pd(), zy = _mm512_setzero_pd();
+        __m512d sx = zx, sy = zy;
+        __mmask8 done = (__mmask8) ~valid;
+
+        if (cardioid) {
+            __m512d xq = _mm512_sub_pd(cx, _mm512_set1_pd(.25));
+            __m512d q = _mm512_fmadd_pd(xq, xq, _mm512_mul_pd(cy, cy));
+            __mmask8 card = _mm512_mask_cmp_pd_mask(valid, _mm512_mul_pd(q, _mm512_add_pd(q, xq)),
+                                                    _mm512_mul_pd(_mm512_set1_pd(.25), _mm512_mul_pd(cy, cy)),
+                                                    _CMP_LE_OQ);
+            __m512d xb = _mm512_add_pd(cx, one);
+            __mmask8 bulb = _mm512_mask_cmp_pd_mask(valid & ~card, _mm512_fmadd_pd(xb, xb, _mm512_mul_pd(cy, cy)),
+                                                    _mm512_set1_pd(1. / 16), _CMP_LE_OQ);
+            saved.cardioid += (long long) __builtin_popcount(card) * MAX_STEPS;
+            saved.bulb += (long long) __builtin_popcount(bulb) * MAX_STEPS;
+            done |= card | bulb;
+        }
+        __m512d cnt = _mm512_maskz_mov_pd(done, max);
+
+        int check = 1;
+        for (int step = 0; step < MAX_STEPS; step++) {
+            __m512d x2 = _mm512_mul_pd(zx, zx);
+            __m512d y2 = _mm512_mul_pd(zy, zy);
+            __mmask8 alive = _mm512_mask_cmp_pd_mask(~done, _mm512_add_pd(x2, y2), four, _CMP_LT_OQ);
+            if (alive == 0) break;
+            cnt = _mm512_mask_add_pd(cnt, alive, cnt, one);
+            zy = _mm512_mask_fmadd_pd(zy, alive, _mm512_add_pd(zx, zx), cy);
+            zx = _mm512_mask_add_pd(zx, alive, _mm512_sub_pd(x2, y2), cx);
+
+            if (periodic) {
+                __mmask8 cycle = _mm512_mask_cmp_pd_mask(alive, _mm512_abs_pd(_mm512_sub_pd(zx, sx)), eps,
+                                                         _CMP_LT_OQ);
+                cycle = _mm512_mask_cmp_pd_mask(cycle, _mm512_abs_pd(_mm512_sub_pd(zy, sy)), eps, _CMP_LT_OQ);
+                if (cycle) {
+                    saved.periodicity += (long long) __builtin_popcount(cycle) * (MAX_STEPS - step - 1);
+                    cnt = _mm512_mask_mov_pd(cnt, cycle, max);
+                    done |= cycle;
+                }
+                if (step == check) {
+                    sx = zx;
+                    sy = zy;
+                    check <<= 1;
+                }
+            }
+        }
+        alignas(32) int out[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(out), _mm512_cvtpd_epi32(cnt));
+        std::copy(out, out + m, steps + j);
+        if (smooth) {
+            alignas(64) double norm[8];
+            _mm512_store_pd(norm, _mm512_fmadd_pd(zx, zx, _mm512_mul_pd(zy, zy)));
+            for (int k = 0; k < m; k++) smooth[j + k] = smoothValue(out[k], norm[k]);
+        }
+    }
+}
+
+// то же в float: вдвое больше линий на вектор. Точность ~1e-7, поэтому порог
+// цикла грубее, а годится это только там, где пиксель намного больше
+__attribute__((target("avx2,fma")))
+void kernel::pointsFloatAvx2(const double *x, const double *y, int n, int *steps, float *smooth) {
+    const __m256 four = _mm256_set1_ps(4.f);
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 max = _mm256_set1_ps(MAX_STEPS);
+    const __m256 eps = _mm256_set1_ps(PERIOD_EPS_FLOAT);
+    const __m256 sign = _mm256_set1_ps(-0.f);
+    const __m256 lane = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+    bool cardioid = options.cardioid.load(std::memory_order_relaxed);
+    bool periodic = options.periodicity.load(std::memory_order_relaxed);
+    Saved saved;
+
+    for (int j = 0; j < n; j += 8) {
+        int m = std::min(8, n - j);
+        alignas(32) float px[8] = {}, py[8] = {};
+        for (int k = 0; k < m; k++) {
+            px[k] = (float) x[j + k];
+            py[k] = (float) y[j + k];
+        }
+        __m256 cx = _mm256_load_ps(px), cy = _mm256_load_ps(py);
+        __m256 pad = _mm256_cmp_ps(lane, _mm256_set1_ps((float) m), _CMP_GE_OQ);
+        __m256 zx = _mm256_setzero_ps(), zy = _mm256_setzero_ps();
+        __m256 sx = zx, sy = zy, done = pad;
+
+        if (cardioid) {
+            __m256 xq = _mm256_sub_ps(cx, _mm256_set1_ps(.25f));
+            __m256 q = _mm256_fmadd_ps(xq, xq, _mm256_mul_ps(cy, cy));
+            __m256 card = _mm256_andnot_ps(pad, _mm256_cmp_ps(_mm256_mul_ps(q, _mm256_add_ps(q, xq)),
+                                                              _mm256_mul_ps(_mm256_set1_ps(.25f), _mm256_mul_ps(cy, cy)),
+                                                              _CMP_LE_OQ));
+            __m256 xb = _mm256_add_ps(cx, one);
+            __m256 bulb = _mm256_andnot_ps(_mm256_or_ps(card, pad),
+                                           _mm256_cmp_ps(_mm256_fmadd_ps(xb, xb, _mm256_mul_ps(cy, cy)),
+                                                         _mm256_set1_ps(1.f / 16), _CMP_LE_OQ));
+            saved.cardioid += (long long) __builtin_popcount(_mm256_movemask_ps(card)) * MAX_STEPS;
+            saved.bulb += (long long) __builtin_popcount(_mm256_movemask_ps(bulb)) * MAX_STEPS;
+            done = _mm256_or_ps(done, _mm256_or_ps(card, bulb));
+        }
+        __m256 cnt = _mm256_and_ps(done, max);
+
+        int check = 1;
+        for (int step = 0; step < MAX_STEPS; step++) {
+            __m256 x2 = _mm256_mul_ps(zx, zx);
+            __m256 y2 = _mm256_mul_ps(zy, zy);
+            __m256 alive = _mm256_andnot_ps(done, _mm256_cmp_ps(_mm256_add_ps(x2, y2), four, _CMP_LT_OQ));
+            if (_mm256_movemask_ps(alive) == 0) break;
+            cnt = _mm256_add_ps(cnt, _mm256_and_ps(alive, one));
+            zy = _mm256_blendv_ps(zy, _mm256_fmadd_ps(_mm256_add_ps(zx, zx), zy, cy), alive);
+            zx = _mm256_blendv_ps(zx, _mm256_add_ps(_mm256_sub_ps(x2, y2), cx), alive);
+
+            if (periodic) {
+                __m256 ex = _mm256_andnot_ps(sign, _mm256_sub_ps(zx, sx));
+                __m256 ey = _mm256_andnot_ps(sign, _mm256_sub_ps(zy, sy));
+                __m256 cycle = _mm256_and_ps(alive, _mm256_and_ps(_mm256_cmp_ps(ex, eps, _CMP_LT_OQ),
+                                                                 _mm256_cmp_ps(ey, eps, _CMP_LT_OQ)));
+                int mask = _mm256_movemask_ps(cycle);
+                if (mask) {
+                    saved.periodicity += (long long) __builtin_popcount(mask) * (MAX_STEPS - step - 1);
+                    cnt = _mm256_blendv_ps(cnt, max, cycle);
+                    done = _mm256_or_ps(done, cycle);
+                }
+                if (step == check) {
+                    sx = zx;
+                    sy = zy;
+                    check <<= 1;
+                }
+            }
+        }
+        alignas(32) int out[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(out), _mm256_cvtps_epi32(cnt));
+        std::copy(out, out + m, steps + j);
+        if (smooth) {
+            alignas(32) float norm[8];
+            _mm256_store_ps(norm, _mm256_fmadd_ps(zx, zx, _mm256_mul_ps(zy, zy)));
+            for (int k = 0; k < m; k++) smooth[j + k] = smoothValue(out[k], norm[k]);
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+void kernel::pointsFloatAvx512(const double *x, const double *y, int n, int *steps, float *smooth) {
+    const __m512 four = _mm512_set1_ps(4.f);
+    const __m512 one = _mm512_set1_ps(1.f);
+    const __m512 max = _mm512_set1_ps(MAX_STEPS);
+    const __m512 eps = _mm512_set1_ps(PERIOD_EPS_FLOAT);
+    bool cardioid = options.cardioid.load(std::memory_order_relaxed);
+    bool periodic = options.periodicity.load(std::memory_order_relaxed);
+    Saved saved;
+
+    for (int j = 0; j < n; j += 16) {
+        int m = std::min(16, n - j);
+        __mmask16 valid = (__mmask16) ((1u << m) - 1);
+        alignas(64) float px[16] = {}, py[16] = {};
+        for (int k = 0; k < m; k++) {
+            px[k] = (float) x[j + k];
+            py[k] = (float) y[j + k];
+        }
+        __m512 cx = _mm512_load_ps(px), cy = _mm512_load_ps(py);
+        __m512 zx = _mm512_setzero_ps(), zy = _mm512_setzero_ps();
+        __m512 sx = zx, sy = zy;
+        __mmask16 done = (__mmask16) ~valid;
+
+        if (cardioid) {
+            __m512 xq = _mm512_sub_ps(cx, _mm512_set1_ps(.25f));
+            __m512 q = _mm512_fmadd_ps(xq, xq, _mm512_mul_ps(cy, cy));
+            __mmask16 card = _mm512_mask_cmp_ps_mask(valid, _mm512_mul_ps(q, _mm512_add_ps(q, xq)),
+                                                     _mm512_mul_ps(_mm512_set1_ps(.25f), _mm512_mul_ps(cy, cy)),
+                                                     _CMP_LE_OQ);
+            __m512 xb = _mm512_add_ps(cx, one);
+            __mmask16 bulb = _mm512_mask_cmp_ps_mask(valid & ~card, _mm512_fmadd_ps(xb, xb, _mm512_mul_ps(cy, cy)),
+                                                     _mm512_set1_ps(1.f / 16), _CMP_LE_OQ);
+            saved.cardioid += (long long) __builtin_popcount(card) * MAX_STEPS;
+            saved.bulb += (long long) __builtin_popcount(bulb) * MAX_STEPS;
+            done |= card | bulb;
+        }
+        __m512 cnt = _mm512_maskz_mov_ps(done, max);
+
+        int check = 1;
+        for (int step = 0; step < MAX_STEPS; step++) {
+            __m512 x2 = _mm512_mul_ps(zx, zx);
+            __m512 y2 = _mm512_mul_ps(zy, zy);
+            __mmask16 alive = _mm512_mask_cmp_ps_mask(~done, _mm512_add_ps(x2, y2), four, _CMP_LT_OQ);
+            if (alive == 0) break;
+            cnt = _mm512_mask_add_ps(cnt, alive, cnt, one);
+            zy = _mm512_mask_fmadd_ps(zy, alive, _mm512_add_ps(zx, zx), cy);
+            zx = _mm512_mask_add_ps(zx, alive, _mm512_sub_ps(x2, y2), cx);
+
+            if (periodic) {
+                __mmask16 cycle = _mm512_mask_cmp_ps_mask(alive, _mm512_abs_ps(_mm512_sub_ps(zx, sx)), eps,
+                                                          _CMP_LT_OQ);
+                cycle = _mm512_mask_cmp_ps_mask(cycle, _mm512_abs_ps(_mm512_sub_ps(zy, sy)), eps, _CMP_LT_OQ);
+                if (cycle) {
+                    saved.periodicity += (long long) __builtin_popcount(cycle) * (MAX_STEPS - step - 1);
+                    cnt = _mm512_mask_mov_ps(cnt, cycle, max);
+                    done |= cycle;
+                }
+                if (step == check) {
+                    sx = zx;
+                    sy = zy;
+                    check <<= 1;
+                }
+            }
+        }
+        alignas(64) int out[16];
+        _mm512_store_si512(out, _mm512_cvtps_epi32(cnt));
+        std::copy(out, out + m, steps + j);
+        if (smooth) {
+            alignas(64) float norm[16];
+            _mm512_store_ps(norm, _mm512_fmadd_ps(zx, zx, _mm512_mul_ps(zy, zy)));
+            for (int k = 0; k < m; k++) smooth[j + k] = smoothValue(out[k], norm[k]);
+        }
+    }
+}
+
+kernel::PointsFunc kernel::selectPoints() {
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma")) return pointsScalar;
+    if (__builtin_cpu_supports("avx512f")) return pointsAvx512;
+    return pointsAvx2;
+}
+
+kernel::PointsFunc kernel::selectPointsFloat() {
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma")) return pointsScalar;
+    if (__builtin_cpu_supports("avx512f")) return pointsFloatAvx512;
+    return pointsFloatAvx2;
+}
+
+#else
+
+void kernel::pointsAvx2(const double *x, const double *y, int n, int *steps, float *smooth) {
+    pointsScalar(x, y, n, steps, smooth);
+}
+
+void kernel::pointsAvx512(const double *x, const double *y, int n, int *steps, float *smooth) {
+    pointsScalar(x, y, n, steps, smooth);
+}
+
+void kernel::pointsFloatAvx2(const double *x, const double *y, int n, int *steps, float *smooth) {
+    pointsScalar(x, y, n, steps, smooth);
+}
+
+void kernel::pointsFloatAvx512(const double *x, const double *y, int n, int *steps, float *smooth) {
+    pointsScalar(x, y, n, steps, smooth);
+}
+
+kernel::PointsFunc kernel::selectPoints() {
+    return pointsScalar;
+}
+
+kernel::PointsFunc kernel::selectPointsFloat() {
+    return pointsScalar;
+}
+
+#endif
+
+kernel::RowFunc kernel::selectRow() {
+    PointsFunc points = selectPoints();
+    if (points == pointsAvx512) return rowAvx512;
+    if (points == pointsAvx2) return rowAvx2;
+    return rowScalar;
+}
+
+kernel::RowFunc kernel::selectRowFloat() {
+    PointsFunc points = selectPointsFloat();
+    if (points == pointsFloatAvx512) return rowFloatAvx512;
+    if (points == pointsFloatAvx2) return rowFloatAvx2;
+    return rowScalar;
+}
+
+const char *kernel::rowName(RowFunc func) {
+    if (func == rowFloatAvx512) return "avx512 float";
+    if (func == rowFloatAvx2) return "avx2 float";
+    if (func == rowAvx512) return "avx512";
+    if (func == rowAvx2) return "avx2";
+    return "scalar";
+}
@@ -0,0 +1,86 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <atomic>
+
+namespace kernel {
+    constexpr int MAX_STEPS = 2000;
+
+    // проверки внутренних точек, каждую можно выключить на ходу
+    struct Options {
+        // главная кардиоида и круг периода 2 отсекаются формулой до итераций
+        std::atomic<bool> cardioid = true;
+        // орбита вернулась в сохраненную точку (по Бренту) -- точка внутри
+        std::atomic<bool> periodicity = true;
+    };
+
+    // сколько итераций сэкономила каждая проверка
+    struct Stats {
+        std::atomic<long long> cardioid = 0, bulb = 0, periodicity = 0;
+
+        void reset() {
+            cardioid = bulb = periodicity = 0;
+        }
+    };
+
+    // счетчики строки, в общие атомики сбрасываются один раз на строку
+    struct Saved {
+        long long cardioid = 0, bulb = 0, periodicity = 0;
+
+        ~Saved();
+    };
+
+    extern Options options;
+    extern Stats stats;
+
+    // считает количество шагов до вылета для n точек строки (x0 + j * dx, y)
+    // точки, не вылетевшие за MAX_STEPS шагов, получают MAX_STEPS.
+    // Если smooth не nullptr, туда пишется сглаженное число шагов
+    using RowFunc = void (*)(double x0, double dx, double y, int n, int *steps, float *smooth);
+
+    // norm -- |z|^2 в момент вылета
+    int iterate(double x, double y, Saved &saved, double &norm);
+
+    // n + 1 - log2(log|z_n|): непрерывно по точке, отличается от n меньше чем на 1
+    float smoothSteps(int steps, double norm);
+
+    // то же для n произвольных точек (x[j], y[j]): так в один вектор
+    // собираются точки, разбросанные по картинке
+    using PointsFunc = void (*)(const double *x, const double *y, int n, int *steps, float *smooth);
+
+    void pointsScalar(const double *x, const double *y, int n, int *steps, float *smooth);
+
+    void pointsAvx2(const double *x, const double *y, int n, int *steps, float *smooth);
+
+    void pointsAvx512(const double *x, const double *y, int n, int *steps, float *smooth);
+
+    void pointsFloatAvx2(const double *x, const double *y, int n, int *steps, float *smooth);
+
+    void pointsFloatAvx512(const double *x, const double *y, int n, int *steps, float *smooth);
+
+    // строки раскладываются в точки и считаются теми же ядрами
+    void rowScalar(double x0, double dx, double y, int n, int *steps, float *smooth);
+
+    void rowAvx2(double x0, double dx, double y, int n, int *steps, float *smooth);
+
+    void rowAvx512(double x0, double dx, double y, int n, int *steps, float *smooth);
+
+    // то же в float, точка считается с ошибкой порядка 1e-7
+    void rowFloatAvx2(double x0, double dx, double y, int n, int *steps, float *smooth);
+
+    void rowFloatAvx512(double x0, double dx, double y, int n, int *steps, float *smooth);
+
+    // выбирает самую широкую реализацию, которую поддерживает процессор
+    RowFunc selectRow();
+
+    // самая широкая float-реализация, без AVX2 -- обычная double
+    RowFunc selectRowFloat();
+
+    PointsFunc selectPoints();
+
+    PointsFunc selectPointsFloat();
+
+    const char *rowName(RowFunc func);
+}
+
+#endif // KERNEL_H
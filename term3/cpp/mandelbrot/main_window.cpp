@@ -4,17 +4,25 @@
 #include <QPainter>
 #include <QThread>
 #include <QDebug>
+#include <chrono>
 #include <complex>
 #include <thread>
 #include <set>
 
+// картинки тайлов живут в ядре, Qt только смотрит на их буфер
+static QImage toQImage(const Image &image) {
+    return {image.constBits(), image.width(), image.height(), (qsizetype) image.bytesPerLine(),
+            QImage::Format_RGB888};
+}
+
 main_window::main_window(QWidget *parent)
         : QMainWindow(parent), ui(new Ui::main_window), status(NONE),
-          threads(std::thread::hardware_concurrency() == 1 ? 1 : std::thread::hardware_concurrency() - 1) {
+          threads(std::thread::hardware_concurrency() == 1 ? 1 : std::thread::hardware_concurrency() - 1),
+          scheduler(threads.size(), maxStep) {
     ui->setupUi(this);
 
     for (size_t i = 0; i < threads.size(); i++) {
-        threads[i] = std::thread(&main_window::generate, this);
+        threads[i] = std::thread(&main_window::generate, this, i);
     }
     coord = {0, 0};
     calculateBlock();
@@ -23,19 +31,40 @@ main_window::main_window(QWidget *parent)
 
 main_window::~main_window() {
     status.store(KILL);
-    cv.notify_all();
+    scheduler.stop();
     for (auto &th: threads) {
         th.join();
     }
 }
 
 void main_window::paintEvent(QPaintEvent *event) {
+    if (composeNeeded) compose();
     QPainter p(this);
-    bool rerender = false;
-    int xp = coord.first % block;
-    int yp = coord.second % block;
-    int xoff = coord.first > 0 ? xp : xp + block;
-    int yoff = coord.second > 0 ? yp : yp + block;
+    p.drawImage(0, 0, framebuffer);
+    if (hud) drawHud(p);
+}
+
+void main_window::invalidate() {
+    composeNeeded = true;
+    update();
+}
+
+void main_window::viewChanged() {
+    viewTime = std::chrono::steady_clock::now();
+    latency = -1;
+    invalidate();
+}
+
+// собирает кадр заново: фон из грубого превью и все тайлы из кэша;
+// заодно ставит в очередь тайлы, которым не хватает детализации
+void main_window::compose() {
+    composeNeeded = false;
+    if (framebuffer.size() != size()) {
+        framebuffer = QImage(size(), QImage::Format_RGB888);
+    }
+    QPainter p(&framebuffer);
+    updateReference();
+    auto origin = (zero - std::complex<double>(coord.first, coord.second) * zoom) - anchor;
 
     {
         int sz = 32;
@@ -46,69 +75,166 @@ void main_window::paintEvent(QPaintEvent *event) {
             prev.first = px / sz;
             prev.second = py / sz;
             auto center = std::complex<double>(py, px) * zoom;
-            auto offset = zero - std::complex<double>(coord.first, coord.second) * zoom;
-            demo.reinit(1, {offset.real(), offset.imag()}, {center.real(), center.imag()}, {prev.first, prev.second},
+            demo.reinit(1, {origin.real(), origin.imag()}, {center.real(), center.imag()}, {prev.first, prev.second},
                         prev.second + block / sz + 1,
-                        prev.first + block / sz + 1);
+                        prev.first + block / sz + 1, reference);
             demo.generateFrame(0);
         }
+        demo.recolor();
         p.setTransform(
                 QTransform((double) px / demo.getImage()->width(), 0, 0, (double) py / demo.getImage()->height(), 0,
                            0));
-        p.drawImage(0, 0, *demo.getImage());
+        p.drawImage(0, 0, toQImage(*demo.getImage()));
     }
 
-    for (int i = -block; i < width(); i += block) {
-        for (int j = -block; j < height(); j += block) {
-            int xc = i - coord.first + xoff;
-            int yc = j - coord.second + yoff;
-            auto center = std::complex<double>(block, block) * zoom;
-            auto offset = zero + std::complex<double>(xc, yc) * zoom;
-            auto frame = render.get({xc, yc}, offset, center, {block, block}, maxStep);
+    // сетка тайлов привязана к нулю комплексной плоскости, а не к окну,
+    // поэтому одни и те же тайлы переживают сдвиги и возвраты зума
+    viewX = std::floor(origin.real() / zoom);
+    viewY = std::floor(origin.imag() / zoom);
+    auto fx = (long long) std::floor(viewX / block), fy = (long long) std::floor(viewY / block);
+    auto center = std::complex<double>(block, block) * zoom;
+
+    render.beginFrame();
+    unfinished.clear();
+    for (long long x = fx; x * block < viewX + width(); x++) {
+        for (long long y = fy; y * block < viewY + height(); y++) {
+            TileKey key{level, anchorId, block, x, y};
+            auto offset = std::complex<double>(x, y) * (block * zoom);
+            auto frame = render.get(key, offset, center, {block, block}, maxStep, reference);
+            frame->recolor();
             auto *image = frame->getImage();
 
             int step = frame->number.load() - 1;
+            if (step != -1) {
+                unfinished.insert(key);
+                // следующие уровни тайл ставит в очередь сам, по готовности
+                if (!frame->work.load()) {
+                    frame->work.store(true);
+                    scheduler.push({frame, step, {&epoch, epoch.load()}, key});
+                }
+            }
+            if (image != nullptr) blit(p, key, *image);
+        }
+    }
+    if (unfinished.empty() && latency < 0) {
+        latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - viewTime).count();
+    }
+}
 
-            if (step != -1) rerender = true;
+void main_window::blit(QPainter &p, const TileKey &key, const Image &image) {
+    double i = key.x * block - viewX, j = key.y * block - viewY;
+    p.setTransform(QTransform((double) block / image.width(), 0, 0, (double) block / image.height(), i, j));
+    p.drawImage(0, 0, toQImage(image));
+}
 
-            if (!frame->work.load() && step != -1) {
-                std::lock_guard lock(mut);
-                frame->work.store(true);
-                queue.push({frame, step});
-                cv.notify_one();
-            } else rerender = true;
+void main_window::tileReady(TileKey key, const std::shared_ptr<RenderFrame> &frame) {
+    // тайл старого зума или старой сетки, или кадр все равно будет собран целиком
+    if (composeNeeded || key.level != level || key.anchor != anchorId || key.block != block) return;
+    double i = key.x * block - viewX, j = key.y * block - viewY;
+    if (i >= width() || j >= height() || i + block <= 0 || j + block <= 0) return;
 
-            if (image != nullptr) {
-                p.setTransform(QTransform((double)block / image->height(), 0, 0, (double)block / image->width(), i + xoff, j + yoff));
-                p.drawImage(0, 0, *image);
-            } else rerender = true;
-        }
+    frame->recolor();
+    if (auto *image = frame->getImage()) {
+        QPainter p(&framebuffer);
+        blit(p, key, *image);
+    }
+    if (frame->number.load() == 0 && unfinished.erase(key) && unfinished.empty() && latency < 0) {
+        latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - viewTime).count();
     }
+    update();
+}
+
+void main_window::drawHud(QPainter &p) {
+    const TileCache &cache = render.getCache();
+    double elapsed = latency >= 0 ? latency : std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - viewTime).count();
+    QString text = QString("%1 %2 ms | tiles left %3 | in flight %4 | queue %5\n"
+                           "cache %6 tiles, %7 MB | hits %8, misses %9\n"
+                           "pixel %10%11")
+            .arg(latency >= 0 ? "latency" : "rendering").arg(elapsed, 0, 'f', 1)
+            .arg(unfinished.size()).arg(inFlight.load()).arg(scheduler.size())
+            .arg(cache.size()).arg((double) cache.memory() / (1 << 20), 0, 'f', 1)
+            .arg(cache.hits()).arg(cache.misses())
+            .arg(zoom, 0, 'g', 3).arg(level >= maxLevel ? " (zoom limit)" : "");
 
-    if (rerender) update();
+    p.resetTransform();
+    QRect rect = p.fontMetrics().boundingRect(QRect(0, 0, width(), height()), Qt::AlignLeft, text);
+    rect.adjust(-6, -4, 6, 4);
+    rect.moveTopLeft({8, 8});
+    p.fillRect(rect, QColor(0, 0, 0, 160));
+    p.setPen(Qt::white);
+    p.drawText(rect.adjusted(6, 4, -6, -4), Qt::AlignLeft, text);
 }
 
-void main_window::generate() {
+void main_window::generate(size_t id) {
     while (status.load() != KILL) {
-        rPair currentTask;
-        {
-            std::unique_lock lock(mut);
-            int kill;
-            cv.wait(lock, [&] { kill = status.load(); return (!queue.empty() || kill == KILL); });
-            if (kill == KILL) break;
-            currentTask = queue.top();
-            queue.pop();
-        }
+        TileScheduler::Task task;
+        if (!scheduler.pop(id, task)) break;
 
-        currentTask.first->generateFrame(currentTask.second);
-        currentTask.first->work.store(false);
+        inFlight.fetch_add(1);
+        bool ready = task.frame->generateFrame(task.step, task.token);
+        inFlight.fetch_sub(1);
+        if (!ready) {
+            task.frame->work.store(false);
+            continue;
+        }
+        // окно узнает о тайле через очередь событий своего потока
+        QMetaObject::invokeMethod(this, [this, key = task.key, frame = task.frame] {
+            tileReady(key, frame);
+        }, Qt::QueuedConnection);
+        if (task.step > 0 && !task.token.cancelled()) {
+            task.step--;
+            scheduler.push(std::move(task));
+        } else {
+            task.frame->work.store(false);
+        }
     }
 }
 
 void main_window::clearQueue() {
-        std::lock_guard lock(mut);
-        queue = std::priority_queue<rPair, std::vector<rPair>, cmp>();
-        cv.notify_all();
+    // сначала отменяем то, что уже считается, потом чистим очередь
+    epoch.fetch_add(1);
+    scheduler.clear();
+}
+
+void main_window::updateReference() {
+    if (RenderFrame::precision(zoom) != RenderFrame::DEEP) {
+        anchor = DComplex();
+        reference = nullptr;
+        anchorId = 0;
+        return;
+    }
+
+    auto center = zero + std::complex<double>(width() / 2. - coord.first, height() / 2. - coord.second) * zoom;
+    double limit = 2. * std::max(width(), height()) * zoom;
+    if (reference && anchorLevel == level && std::abs(center - anchor) < limit) return;
+
+    // орбита стоит пару тысяч итераций, так что считаем ее прямо здесь
+    anchor = center;
+    anchorLevel = level;
+    anchorId = ++anchors;
+    reference = std::make_shared<const ReferenceOrbit>(anchor, kernel::MAX_STEPS);
+    clearQueue();
+}
+
+void main_window::showKernelStats() {
+    auto &opt = kernel::options;
+    auto &st = kernel::stats;
+    auto &fr = RenderFrame::stats;
+    statusBar()->showMessage(QString("cardioid %1: %2 saved, bulb: %3 saved | periodicity %4: %5 saved | "
+                                     "borders %6: %7 evaluated, %8 filled | inherit %9: %10 reused | "
+                                     "smooth %11, palette %12 | float %13: %14 px")
+                                     .arg(opt.cardioid.load() ? "on" : "off").arg(st.cardioid.load())
+                                     .arg(st.bulb.load())
+                                     .arg(opt.periodicity.load() ? "on" : "off").arg(st.periodicity.load())
+                                     .arg(RenderFrame::mode.load() == RenderFrame::BORDERS ? "on" : "off")
+                                     .arg(fr.evaluated.load()).arg(fr.filled.load())
+                                     .arg(RenderFrame::inheritUniform.load() ? "on" : "off")
+                                     .arg(fr.inherited.load())
+                                     .arg(RenderFrame::smooth.load() ? "on" : "off")
+                                     .arg(palette::name(palette::current.load()))
+                                     .arg(RenderFrame::allowFloat.load() ? "on" : "off")
+                                     .arg(fr.single.load()));
 }
 
 void main_window::keyPressEvent(QKeyEvent *event) {
@@ -116,6 +242,48 @@ void main_window::keyPressEvent(QKeyEvent *event) {
         case Qt::Key_Q:
             close();
             break;
+        case Qt::Key_C:
+            kernel::options.cardioid.store(!kernel::options.cardioid.load());
+            showKernelStats();
+            break;
+        case Qt::Key_P:
+            kernel::options.periodicity.store(!kernel::options.periodicity.load());
+            showKernelStats();
+            break;
+        case Qt::Key_M:
+            RenderFrame::mode.store(RenderFrame::mode.load() == RenderFrame::PIXELS ? RenderFrame::BORDERS
+                                                                                     : RenderFrame::PIXELS);
+            showKernelStats();
+            break;
+        case Qt::Key_I:
+            RenderFrame::inheritUniform.store(!RenderFrame::inheritUniform.load());
+            showKernelStats();
+            break;
+        case Qt::Key_G:
+            RenderFrame::smooth.store(!RenderFrame::smooth.load());
+            showKernelStats();
+            break;
+        case Qt::Key_K:
+            palette::select(palette::current.load() + 1);
+            showKernelStats();
+            invalidate();
+            break;
+        case Qt::Key_Comma:
+        case Qt::Key_Period:
+            palette::shift(event->key() == Qt::Key_Period ? 1.f / 32 : -1.f / 32);
+            invalidate();
+            break;
+        case Qt::Key_F:
+            RenderFrame::allowFloat.store(!RenderFrame::allowFloat.load());
+            showKernelStats();
+            break;
+        case Qt::Key_H:
+            hud = !hud;
+            update();
+            break;
+        case Qt::Key_S:
+            showKernelStats();
+            break;
         default:
             QWidget::keyPressEvent(event);
     }
@@ -124,16 +292,21 @@ void main_window::keyPressEvent(QKeyEvent *event) {
 void main_window::wheelEvent(QWheelEvent *event) {
     QPoint numD = event->angleDelta();
     double sign = numD.ry() < 0 ? -1 : 1;
+    if (sign > 0 && level >= maxLevel) {
+        statusBar()->showMessage(QString("zoom limit: pixel %1").arg(zoom, 0, 'g', 3), 3000);
+        return;
+    }
     double part = 5;
     coord.first += sign * (width() / part - event->position().x()) / part;
     coord.second += sign * (height() / part - event->position().y()) / part;
-    zero -= zoom * std::complex<double>(coord.first, coord.second);
+    zero = zero - std::complex<double>(coord.first, coord.second) * zoom;
     coord = {0, 0};
-    zoom *= std::pow(.9, sign);
+    level += (int) sign;
+    zoom = 1. / 400 * std::pow(.9, level);
 
     clearQueue();
     render.init(width(), height(), block);
-    update();
+    viewChanged();
 }
 
 void main_window::mousePressEvent(QMouseEvent *event) {
@@ -141,7 +314,7 @@ void main_window::mousePressEvent(QMouseEvent *event) {
         scribbling = true;
         mouse.first = event->position().x();
         mouse.second = event->position().y();
-        update();
+        invalidate();
     }
 }
 
@@ -152,7 +325,7 @@ void main_window::mouseReleaseEvent(QMouseEvent *event) {
         scribbling = false;
         //clearQueue();
         //render.clear(coord.first + width(), coord.second + height(), 0, 0);
-        update();
+        invalidate();
     }
 }
 
@@ -162,7 +335,7 @@ void main_window::mouseMoveEvent(QMouseEvent *event) {
         coord.second += event->position().y() - mouse.second;
         mouse.first = event->position().x();
         mouse.second = event->position().y();
-        update();
+        viewChanged();
     }
 }
 
@@ -180,6 +353,6 @@ void main_window::resizeEvent(QResizeEvent *event) {
     clearQueue();
     calculateBlock();
     render.init(width(), height(), block);
-    update();
+    viewChanged();
 }
 
@@ -5,14 +5,16 @@
 #include <QWidget>
 #include <QPainter>
 #include <QKeyEvent>
+#include <chrono>
+#include <cmath>
 #include <memory>
+#include <set>
 #include <thread>
-#include <mutex>
-#include <queue>
 #include <complex>
-#include <condition_variable>
 #include "ui_main_window.h"
+#include "palette.h"
 #include "render.h"
+#include "scheduler.h"
 
 
 QT_BEGIN_NAMESPACE
@@ -45,12 +47,18 @@ protected:
 private:
     const int maxStep = 3;
     std::pair<int, int> mouse = {0, 0}, prev = {-1, -1}, coord = {0, 0};
-    int px = 0, py = 0, block = 128;
+    int px = 0, py = 0, block = 128, level = 0;
     double zoom = 1. / 400, pz = 0.;
-    std::complex<double> zero = {0, 0};
+    // zoom = 1 / 400 * 0.9^level, глубже RenderFrame::MIN_PIXEL не пускаем
+    const int maxLevel = (int) (std::log(RenderFrame::MIN_PIXEL * 400) / std::log(.9));
+    DComplex zero;
+
+    // центр опорной орбиты, относительно него считаются тайлы; на обычном
+    // зуме это ноль и орбиты нет
+    DComplex anchor;
+    std::shared_ptr<const ReferenceOrbit> reference;
+    int anchorId = 0, anchorLevel = 0, anchors = 0;
 
-    std::mutex mut;
-    std::condition_variable cv;
     std::vector<std::thread> threads;
     std::unique_ptr<Ui::main_window> ui;
 
@@ -61,25 +69,57 @@ private:
         KILL
     };
 
-    using rPair = std::pair<std::shared_ptr<RenderFrame>, int>;
-
-    struct cmp {
-        bool operator()(const rPair &a, const rPair &b) {
-            return a.second < b.second;
-        }
-    };
-
     Render render;
     RenderFrame demo;
     std::atomic<STATUS> status;
-    std::priority_queue<std::pair<std::shared_ptr<RenderFrame>, int>, std::vector<rPair>, cmp> queue;
+    // эпоха вида, тайлы из прошлых эпох бросают расчет
+    std::atomic<unsigned> epoch = 0;
+    TileScheduler scheduler;
 
     bool scribbling = false;
 
-    void generate();
+    // кадр собирается здесь: готовые тайлы дорисовываются по одному, а
+    // paintEvent только копирует его на экран
+    QImage framebuffer;
+    bool composeNeeded = true;
+    // левый верхний угол окна в пикселях сетки тайлов
+    double viewX = 0, viewY = 0;
+    // видимые тайлы, еще не досчитанные до полной детализации
+    std::set<TileKey> unfinished;
+    std::chrono::steady_clock::time_point viewTime = std::chrono::steady_clock::now();
+    // время от смены вида до полной детализации, -1 -- еще считается
+    double latency = -1;
+    std::atomic<int> inFlight = 0;
+    bool hud = true;
+
+    void generate(size_t id);
+
+    // вид не менялся, но кадр надо собрать заново (палитра, превью)
+    void invalidate();
+
+    // сдвиг, зум или размер окна: еще и сбрасывает замер задержки
+    void viewChanged();
+
+    void compose();
+
+    void blit(QPainter &p, const TileKey &key, const Image &image);
+
+    // вызывается в потоке окна, когда поток досчитал уровень тайла
+    void tileReady(TileKey key, const std::shared_ptr<RenderFrame> &frame);
+
+    // H прячет и показывает
+    void drawHud(QPainter &p);
 
     void clearQueue();
 
+    void updateReference();
+
+    // C и P переключают проверки внутренних точек, M -- обход границ,
+    // I -- заливку по грубому уровню, G -- сглаживание, K -- палитру
+    // (запятая и точка ее крутят), F -- float на мелком зуме,
+    // S показывает, сколько работы сэкономлено
+    void showKernelStats();
+
     void calculateBlock();
 };
 
@@ -11,13 +11,22 @@ CONFIG += sanitize_address
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    deep.cpp \
+    kernel.cpp \
     main.cpp \
     main_window.cpp \
-    render.cpp
+    palette.cpp \
+    render.cpp \
+    scheduler.cpp
 
 HEADERS += \
+    deep.h \
+    image.h \
+    kernel.h \
     main_window.h \
-    render.h
+    palette.h \
+    render.h \
+    scheduler.h
 
 FORMS += \
     main_window.ui
@@ -0,0 +1,94 @@
+#include "palette.h"
+#include "kernel.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iterator>
+
+std::atomic<int> palette::current = 0;
+std::atomic<float> palette::offset = 0;
+std::atomic<unsigned> palette::version = 0;
+
+namespace {
+    using Table = std::array<palette::Color, palette::SIZE>;
+
+    struct Entry {
+        const char *name;
+        Table table;
+    };
+
+    // кусочно-линейный градиент по опорным цветам, замкнутый в кольцо
+    Table gradient(std::initializer_list<palette::Color> stops) {
+        Table res;
+        int n = (int) stops.size();
+        for (int i = 0; i < palette::SIZE; i++) {
+            double t = (double) i * n / palette::SIZE;
+            int k = (int) t;
+            double f = t - k;
+            const palette::Color &a = stops.begin()[k], &b = stops.begin()[(k + 1) % n];
+            res[i] = {(unsigned char) std::lround(a.r + (b.r - a.r) * f),
+                      (unsigned char) std::lround(a.g + (b.g - a.g) * f),
+                      (unsigned char) std::lround(a.b + (b.b - a.b) * f)};
+        }
+        return res;
+    }
+
+    // прежняя пила (step % 51) / 50 по красному и зеленому
+    Table classic() {
+        Table res;
+        for (int i = 0; i < palette::SIZE; i++) {
+            double val = (double) i / palette::SIZE;
+            res[i] = {(unsigned char) (val * 0xff), (unsigned char) (val * 0xff * 0.3), 0};
+        }
+        return res;
+    }
+
+    const Entry TABLES[] = {
+            {"classic", classic()},
+            {"ultra",   gradient({{0, 7, 100}, {32, 107, 203}, {237, 255, 255}, {255, 170, 0}, {0, 2, 0}})},
+            {"gray",    gradient({{0, 0, 0}, {255, 255, 255}})},
+    };
+}
+
+int palette::count() {
+    return std::size(TABLES);
+}
+
+const char *palette::name(int index) {
+    return TABLES[index].name;
+}
+
+void palette::select(int index) {
+    current.store(index % count());
+    version.fetch_add(1);
+}
+
+void palette::shift(float delta) {
+    float cur = offset.load() + delta;
+    offset.store(cur - std::floor(cur));
+    version.fetch_add(1);
+}
+
+void palette::apply(const float *values, int n, unsigned char *rgb) {
+    const Table &table = TABLES[current.load(std::memory_order_relaxed)].table;
+    const float scale = SIZE / PERIOD;
+    const float base = offset.load(std::memory_order_relaxed) * SIZE;
+    constexpr int CHUNK = 256;
+    int index[CHUNK];
+
+    // индексы считаются отдельным циклом без ветвлений, он векторизуется;
+    // выборка из таблицы -- уже поэлементно
+    for (int start = 0; start < n; start += CHUNK) {
+        int len = std::min(CHUNK, n - start);
+        const float *v = values + start;
+        for (int j = 0; j < len; j++) {
+            index[j] = v[j] >= kernel::MAX_STEPS ? -1 : (int) (v[j] * scale + base) & (SIZE - 1);
+        }
+        for (int j = 0; j < len; j++) {
+            Color c = index[j] < 0 ? Color{0, 0, 0} : table[index[j]];
+            *rgb++ = c.r;
+            *rgb++ = c.g;
+            *rgb++ = c.b;
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <atomic>
+
+// раскраска отделена от счета: тайл хранит сглаженное число шагов, а цвет
+// берется из таблицы, так что смена палитры или ее сдвиг не требуют пересчета
+namespace palette {
+    constexpr int SIZE = 1024;
+    // сколько шагов проходит за один оборот палитры
+    constexpr float PERIOD = 51;
+
+    struct Color {
+        unsigned char r, g, b;
+    };
+
+    // номер палитры и сдвиг по кругу в долях оборота
+    extern std::atomic<int> current;
+    extern std::atomic<float> offset;
+    // растет при каждом изменении, по нему тайлы понимают, что пора перекраситься
+    extern std::atomic<unsigned> version;
+
+    int count();
+
+    const char *name(int index);
+
+    void select(int index);
+
+    void shift(float delta);
+
+    // переводит n значений в RGB888, внутренние точки (MAX_STEPS) черные
+    void apply(const float *values, int n, unsigned char *rgb);
+}
+
+#endif // PALETTE_H
@@ -1,80 +1,358 @@
 #include "render.h"
+#include "kernel.h"
+#include "palette.h"
+#include <algorithm>
+#include <cmath>
 #include <complex>
 
-double RenderFrame::getPixelColor(double x, double y) {
-    std::complex<double> z = 0, c(x, y);
-
-    size_t step = 0;
-    size_t const MAX_STEPS = 2000;
-
-    for (;;) {
-        if (z.real() * z.real() + z.imag() * z.imag() >= 4.) return (step % 51) / 50.;
-        if (step == MAX_STEPS) return 0;
-        z = z * z + c;
-        step++;
-    }
-}
+// выбираем реализацию один раз, дальше это просто косвенный вызов
+const kernel::RowFunc RenderFrame::row = kernel::selectRow();
+const kernel::RowFunc RenderFrame::rowFloat = kernel::selectRowFloat();
+const kernel::PointsFunc RenderFrame::points = kernel::selectPoints();
+const kernel::PointsFunc RenderFrame::pointsFloat = kernel::selectPointsFloat();
+std::atomic<RenderFrame::MODE> RenderFrame::mode = RenderFrame::PIXELS;
+std::atomic<bool> RenderFrame::inheritUniform = false;
+std::atomic<bool> RenderFrame::smooth = true;
+std::atomic<bool> RenderFrame::allowFloat = true;
+RenderFrame::Stats RenderFrame::stats;
 
 RenderFrame::RenderFrame(int step, std::pair<double, double> coord, std::pair<double, double> center,
                          std::pair<double, double> p, int ysz,
-                         int xsz) {
-    reinit(step, coord, center, p, ysz, xsz);
+                         int xsz, std::shared_ptr<const ReferenceOrbit> ref) {
+    reinit(step, coord, center, p, ysz, xsz, std::move(ref));
 }
 
-void RenderFrame::generateFrame(int step) {
-    uchar *image_start = img[step].bits();
+bool RenderFrame::generateFrame(int step, CancelToken token) {
     int w = img[step].width();
     int h = img[step].height();
+    std::vector<int> &steps = counts[step];
+    steps.resize(w * h);
+    values[step].resize(w * h);
+    std::vector<char> known(w * h, 0);
 
+    // на грубых уровнях пиксель крупнее, поэтому они дольше остаются во float
+    bool single = !ref && precision(center.second / w) == FLOAT;
+    Pass pass{w, h, 0, single ? rowFloat : row, single ? pointsFloat : points, steps.data(), values[step].data(),
+              known.data(), smooth.load()};
+    if (ref) {
+        double radius = 0;
+        for (double x: {coord.first, coord.first + center.second}) {
+            for (double y: {coord.second, coord.second + center.first}) {
+                radius = std::max(radius, std::hypot(x, y));
+            }
+        }
+        pass.skip = ref->skip(radius);
+    }
 
-    for (int i = 0; i < h; i++) {
-        uchar *p = image_start + i * img[step].bytesPerLine();
-        double y_off = (double) i / h * center.first + coord.second;
-        for (int j = 0; j < w; j++) {
-            double x_off = (double) j / w * center.second + coord.first;
-            double val = this->getPixelColor(x_off, y_off);
-            *p++ = static_cast<uchar>(val * 0xff);
-            *p++ = static_cast<uchar>(val * 0xff * 0.3);
-            *p++ = 0;
+    long long inherited = inherit(step, pass);
+
+    if (mode.load() == BORDERS) {
+        if (!subdivide(pass, token)) return false;
+    } else {
+        for (int i = 0; i < h; i++) {
+            if (token.cancelled()) return false;
+            line(pass, i, 0, w - 1);
         }
     }
+    stats.evaluated.fetch_add(pass.evaluated, std::memory_order_relaxed);
+    stats.filled.fetch_add(pass.filled, std::memory_order_relaxed);
+    stats.inherited.fetch_add(inherited, std::memory_order_relaxed);
+    if (single) stats.single.fetch_add(pass.evaluated, std::memory_order_relaxed);
+    stats.steps.fetch_add(pass.total, std::memory_order_relaxed);
+
+    colorize(step);
+    // более грубый уровень освобождает recolor(): до этой строки number
+    // указывал на него, и окно могло как раз его перекрашивать
     number.store(std::min(number.load(), step));
+    return true;
+}
+
+void RenderFrame::colorize(int step) {
+    colored[step] = palette::version.load();
+    palette::apply(values[step].data(), (int) values[step].size(), img[step].bits());
+}
+
+bool RenderFrame::recolor() {
+    int step = number.load();
+    // уровни грубее показанного больше никому не нужны: следующий расчет
+    // берет точки только с уровня step
+    for (int i = step + 1; i < (int) counts.size(); i++) {
+        std::vector<int>().swap(counts[i]);
+        std::vector<float>().swap(values[i]);
+    }
+    if (step >= (int) img.size() || colored[step] == palette::version.load()) return false;
+    colorize(step);
+    return true;
+}
+
+// уровни отличаются в 4 раза по каждой оси, так что каждая 4-я точка каждой
+// 4-й строки уже посчитана на грубом уровне ровно в той же точке плоскости.
+// Если все 4 угла клетки грубого уровня совпали, клетка заливается целиком:
+// это та же идея, что у обхода границ, только по редкой сетке. Углов мало,
+// между ними может пройти тонкая нить, так что заливка -- эвристика и по
+// умолчанию выключена
+long long RenderFrame::inherit(int step, Pass &pass) const {
+    if (step + 1 >= (int) counts.size() || counts[step + 1].empty()) return 0;
+    int cw = img[step + 1].width(), ch = img[step + 1].height();
+    if (cw * 4 != pass.w || ch * 4 != pass.h) return 0;
+    const int *coarse = counts[step + 1].data();
+    const float *coarseValues = values[step + 1].data();
+    long long res = 0;
+
+    for (int i = 0; i < ch; i++) {
+        for (int j = 0; j < cw; j++) {
+            pass.steps[4 * i * pass.w + 4 * j] = coarse[i * cw + j];
+            pass.values[4 * i * pass.w + 4 * j] = coarseValues[i * cw + j];
+            pass.known[4 * i * pass.w + 4 * j] = 1;
+            res++;
+        }
+    }
+    if (!inheritUniform.load()) return res;
+
+    for (int i = 0; i + 1 < ch; i++) {
+        for (int j = 0; j + 1 < cw; j++) {
+            int value = coarse[i * cw + j];
+            if (coarse[i * cw + j + 1] != value || coarse[(i + 1) * cw + j] != value ||
+                coarse[(i + 1) * cw + j + 1] != value || !fillable(pass, value)) {
+                continue;
+            }
+            for (int y = 4 * i; y <= 4 * i + 4; y++) {
+                for (int x = 4 * j; x <= 4 * j + 4; x++) {
+                    if (pass.known[y * pass.w + x]) continue;
+                    pass.steps[y * pass.w + x] = value;
+                    pass.values[y * pass.w + x] = (float) value;
+                    pass.known[y * pass.w + x] = 1;
+                    res++;
+                }
+            }
+        }
+    }
+    return res;
+}
+
+void RenderFrame::evaluate(const Pass &pass, int i, int j, int n) const {
+    double y_off = (double) i / pass.h * center.first + coord.second;
+    double dx = center.second / pass.w;
+    int *out = pass.steps + i * pass.w + j;
+    float *values = pass.values + i * pass.w + j;
+    float *smooth = pass.smooth ? values : nullptr;
+    if (ref) {
+        ref->row(coord.first + j * dx, dx, y_off, n, pass.skip, out, smooth);
+    } else {
+        pass.row(coord.first + j * dx, dx, y_off, n, out, smooth);
+    }
+    if (!smooth) {
+        for (int k = 0; k < n; k++) values[k] = (float) out[k];
+    }
+}
+
+void RenderFrame::line(Pass &pass, int y, int x0, int x1) const {
+    char *known = pass.known + y * pass.w;
+    for (int x = x0; x <= x1;) {
+        if (known[x]) {
+            x++;
+            continue;
+        }
+        int end = x;
+        while (end <= x1 && !known[end]) known[end++] = 1;
+        evaluate(pass, y, x, end - x);
+        for (int k = x; k < end; k++) pass.total += pass.steps[y * pass.w + k] - pass.skip;
+        pass.evaluated += end - x;
+        x = end;
+    }
+}
+
+void RenderFrame::defer(Pass &pass, int i, int j) const {
+    int index = i * pass.w + j;
+    if (pass.known[index]) return;
+    pass.known[index] = 1;
+    pass.batch.push_back(index);
+    pass.batchX.push_back(coord.first + j * (center.second / pass.w));
+    pass.batchY.push_back((double) i / pass.h * center.first + coord.second);
+}
+
+bool RenderFrame::flush(Pass &pass, CancelToken token) const {
+    int n = (int) pass.batch.size();
+    if (n == 0) return true;
+    pass.batchSteps.resize(n);
+    pass.batchValues.resize(n);
+    float *smooth = pass.smooth ? pass.batchValues.data() : nullptr;
+    // отмену проверяем по кускам примерно в строку картинки, как и при счете
+    // по строкам, но не мельче нескольких векторов
+    int chunk = std::max(pass.w, 64);
+    for (int k0 = 0; k0 < n; k0 += chunk) {
+        if (token.cancelled()) return false;
+        int m = std::min(chunk, n - k0);
+        const double *x = pass.batchX.data() + k0, *y = pass.batchY.data() + k0;
+        float *out = smooth ? smooth + k0 : nullptr;
+        if (ref) {
+            ref->points(x, y, m, pass.skip, pass.batchSteps.data() + k0, out);
+        } else {
+            pass.points(x, y, m, pass.batchSteps.data() + k0, out);
+        }
+    }
+    for (int k = 0; k < n; k++) {
+        pass.steps[pass.batch[k]] = pass.batchSteps[k];
+        pass.values[pass.batch[k]] = smooth ? smooth[k] : (float) pass.batchSteps[k];
+        pass.total += pass.batchSteps[k] - pass.skip;
+    }
+    pass.evaluated += n;
+    pass.batch.clear();
+    pass.batchX.clear();
+    pass.batchY.clear();
+    return true;
+}
+
+// Мариани-Силвер: считаем только границу прямоугольника, если на ней везде
+// одно и то же число шагов, то и внутри оно такое же (множества уровня у
+// мандельброта связны), иначе делим пополам и повторяем.
+// Прямоугольники идут поколениями, и неизвестные точки границ всего поколения
+// (вместе с внутренностями мелких прямоугольников прошлого) считаются одним
+// вызовом ядра: по отдельности короткие куски сторон занимали бы по целому
+// вектору, и обход выходил медленнее, чем посчитать все точки подряд
+bool RenderFrame::subdivide(Pass &pass, CancelToken token) const {
+    struct Rect {
+        int x0, y0, x1, y1;
+    };
+    int w = pass.w;
+    int *steps = pass.steps;
+
+    std::vector<Rect> current = {{0, 0, w - 1, pass.h - 1}}, next;
+    while (!current.empty()) {
+        // соседние точки вектора должны быть соседями и на картинке, иначе
+        // вектор ждет самую долгую из непохожих точек
+        for (const Rect &r: current) {
+            for (int x = r.x0; x <= r.x1; x++) defer(pass, r.y0, x);
+            for (int y = r.y0 + 1; y < r.y1; y++) defer(pass, y, r.x1);
+            for (int x = r.x1; x >= r.x0; x--) defer(pass, r.y1, x);
+            for (int y = r.y1 - 1; y > r.y0; y--) defer(pass, y, r.x0);
+        }
+        if (!flush(pass, token)) return false;
+
+        next.clear();
+        for (const Rect &r: current) {
+            int value = steps[r.y0 * w + r.x0];
+            bool uniform = true;
+            for (int x = r.x0; uniform && x <= r.x1; x++) {
+                uniform = steps[r.y0 * w + x] == value && steps[r.y1 * w + x] == value;
+            }
+            for (int y = r.y0; uniform && y <= r.y1; y++) {
+                uniform = steps[y * w + r.x0] == value && steps[y * w + r.x1] == value;
+            }
+
+            if (uniform && fillable(pass, value)) {
+                for (int y = r.y0 + 1; y < r.y1; y++) {
+                    for (int x = r.x0 + 1; x < r.x1; x++) {
+                        if (pass.known[y * w + x]) continue;
+                        steps[y * w + x] = value;
+                        pass.values[y * w + x] = (float) value;
+                        pass.known[y * w + x] = 1;
+                        pass.filled++;
+                    }
+                }
+            } else if (uniform || r.x1 - r.x0 < 8 || r.y1 - r.y0 < 8) {
+                // однородную область со сглаживанием все равно придется считать
+                // целиком, делить ее дальше незачем; у мелких границы почти
+                // весь прямоугольник, их выгоднее досчитать сразу
+                for (int y = r.y0 + 1; y < r.y1; y++) {
+                    for (int x = r.x0 + 1; x < r.x1; x++) defer(pass, y, x);
+                }
+            } else if (r.x1 - r.x0 >= r.y1 - r.y0) {
+                int mid = (r.x0 + r.x1) / 2;
+                next.push_back({r.x0, r.y0, mid, r.y1});
+                next.push_back({mid, r.y0, r.x1, r.y1});
+            } else {
+                int mid = (r.y0 + r.y1) / 2;
+                next.push_back({r.x0, r.y0, r.x1, mid});
+                next.push_back({r.x0, mid, r.x1, r.y1});
+            }
+        }
+        std::swap(current, next);
+    }
+    return flush(pass, token);
 }
 
 void
 RenderFrame::reinit(int step, std::pair<double, double> coord, std::pair<double, double> center,
-                    std::pair<double, double> p, int ysz, int xsz) {
+                    std::pair<double, double> p, int ysz, int xsz, std::shared_ptr<const ReferenceOrbit> ref) {
     this->p = p;
+    this->ref = std::move(ref);
     this->coord = coord;
     this->center = center;
 
 
     img.clear();
+    counts.assign(step, {});
+    values.assign(step, {});
+    colored.assign(step, 0);
     int dstep = 1;
     for (int i = 0; i < step; i++) {
-        img.emplace_back(xsz / dstep, ysz / dstep, QImage::Format::Format_RGB888);
+        img.emplace_back(xsz / dstep, ysz / dstep);
         dstep <<= 2;
     }
     this->number.store(step);
 }
 
+size_t RenderFrame::memory() const {
+    size_t res = 0;
+    // считаем по максимуму, чтобы размер тайла не менялся, пока он в кэше
+    for (auto &image: img) {
+        res += image.sizeInBytes() + (sizeof(int) + sizeof(float)) * image.width() * image.height();
+    }
+    return res;
+}
+
+std::shared_ptr<RenderFrame> TileCache::find(const TileKey &key) {
+    auto it = map.find(key);
+    if (it == map.end()) {
+        missCount++;
+        return nullptr;
+    }
+    hitCount++;
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->second;
+}
+
+void TileCache::insert(const TileKey &key, std::shared_ptr<RenderFrame> frame, size_t keep) {
+    used += frame->memory();
+    lru.emplace_front(key, std::move(frame));
+    map[key] = lru.begin();
+
+    while (used > budget && map.size() > keep) {
+        used -= lru.back().second->memory();
+        map.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+void TileCache::clear() {
+    lru.clear();
+    map.clear();
+    used = 0;
+}
+
 void Render::init(int w, int h, int block) {
     this->w = w;
     this->h = h;
+    // при другом размере блока сетка тайлов не совпадает со старой
+    if (this->block != block) {
+        cache.clear();
+    }
     this->block = block;
-    map.clear();
 }
 
 std::shared_ptr<RenderFrame>
-Render::get(std::pair<int, int> coord, std::complex<double> offset, std::complex<double> center,
+Render::get(TileKey key, std::complex<double> offset, std::complex<double> center,
             std::pair<double, double> p,
-            int step) {
-    if (map.count(coord) != 0) {
-        return map[coord];
+            int step, std::shared_ptr<const ReferenceOrbit> ref) {
+    touched++;
+    if (auto frame = cache.find(key)) {
+        return frame;
     }
 
-    map[coord] = std::make_shared<RenderFrame>(step, std::pair<double, double>{offset.real(), offset.imag()},
+    auto frame = std::make_shared<RenderFrame>(step, std::pair<double, double>{offset.real(), offset.imag()},
                                                std::pair<double, double>{center.real(), center.imag()}, p, block,
-                                               block);
-    return map[coord];
+                                               block, std::move(ref));
+    cache.insert(key, frame, touched);
+    return frame;
 }
@@ -1,21 +1,40 @@
 ﻿#ifndef RENDER_H
 #define RENDER_H
 
-#include <QMainWindow>
-#include <QKeyEvent>
-#include <QPainter>
-#include <condition_variable>
 #include <atomic>
-#include <mutex>
-#include <queue>
 #include <memory>
-#include <set>
+#include <vector>
+#include <map>
+#include <list>
+#include <tuple>
 #include <complex>
+#include "kernel.h"
+#include "deep.h"
+#include "image.h"
 
 
+// тайл, поставленный в очередь для старого вида, уже никому не нужен:
+// при смене вида эпоха увеличивается, и расчет бросается на ближайшей строке
+struct CancelToken {
+    const std::atomic<unsigned> *current = nullptr;
+    unsigned epoch = 0;
+
+    bool cancelled() const {
+        return current != nullptr && current->load(std::memory_order_relaxed) != epoch;
+    }
+};
+
 class RenderFrame {
     std::pair<double, double> coord, center, p;
-    std::vector<QImage> img;
+    std::vector<Image> img;
+    // число шагов по точкам каждого уровня, пока из него можно что-то взять
+    std::vector<std::vector<int>> counts;
+    // сглаженное число шагов, из него картинка перекрашивается без пересчета
+    std::vector<std::vector<float>> values;
+    // версия палитры, которой раскрашен уровень
+    std::vector<unsigned> colored;
+    // если есть опорная орбита, coord -- смещение от ее центра
+    std::shared_ptr<const ReferenceOrbit> ref;
     int px = 1, py = 1;
 
 public:
@@ -26,15 +45,23 @@ public:
     RenderFrame() = default;
 
     RenderFrame(int step, std::pair<double, double> coord, std::pair<double, double> center,
-                std::pair<double, double> p, int ysz, int xsz);
+                std::pair<double, double> p, int ysz, int xsz, std::shared_ptr<const ReferenceOrbit> ref = nullptr);
 
-    void generateFrame(int step);
+    // false, если расчет отменили и картинка уровня step не готова
+    bool generateFrame(int step, CancelToken token = {});
 
     void
     reinit(int step, std::pair<double, double> coord, std::pair<double, double> center, std::pair<double, double> p,
-           int ysz, int xsz);
+           int ysz, int xsz, std::shared_ptr<const ReferenceOrbit> ref = nullptr);
+
+    size_t memory() const;
+
+    // перекрашивает готовый уровень, если палитра сменилась, и освобождает
+    // более грубые; вызывается из потока, который рисует, true -- картинка
+    // изменилась
+    bool recolor();
 
-    QImage *getImage() {
+    Image *getImage() {
         if (number.load() >= (int) img.size()) return nullptr;
         return &img[number.load()];
     }
@@ -42,26 +69,172 @@ public:
     std::atomic<bool> done = false, work = false;
     std::atomic<int> number;
 
+    enum MODE {
+        PIXELS,
+        // обход границ прямоугольников с заливкой однородных
+        BORDERS
+    };
+
+    struct Stats {
+        // посчитанные итерациями точки, точки, залитые без счета, и точки,
+        // взятые с более грубого уровня
+        std::atomic<long long> evaluated = 0, filled = 0, inherited = 0;
+        // сколько из посчитанных прошло через float
+        std::atomic<long long> single = 0;
+        // сумма шагов посчитанных точек без пропущенных рядом у опорной орбиты;
+        // проверки внутренних точек отсюда не вычтены, см. kernel::stats
+        std::atomic<long long> steps = 0;
+    };
+
+    // точность выбирается по размеру пикселя: пока он на много порядков больше
+    // шага float, хватает float, дальше double, а когда и его не хватает --
+    // отклонения от опорной орбиты
+    enum PRECISION {
+        FLOAT,
+        DOUBLE,
+        DEEP
+    };
+
+    static constexpr double FLOAT_PIXEL = 1e-3;
+    static constexpr double DEEP_PIXEL = 1e-12;
+    // мельче центр вида в DDouble уже не различает соседние пиксели
+    static constexpr double MIN_PIXEL = 1e-30;
+
+    static PRECISION precision(double pixel) {
+        if (pixel < DEEP_PIXEL) return DEEP;
+        return pixel >= FLOAT_PIXEL && allowFloat.load() ? FLOAT : DOUBLE;
+    }
+
+    static std::atomic<MODE> mode;
+    // заливать клетки грубого уровня с одинаковыми углами; быстрее, но
+    // картинка уже не точная, поэтому по умолчанию выключено
+    static std::atomic<bool> inheritUniform;
+    // сглаженная раскраска; с ней заливать можно только внутренние точки,
+    // иначе однородные области будут видны плоскими пятнами
+    static std::atomic<bool> smooth;
+    // можно ли считать крупные пиксели во float
+    static std::atomic<bool> allowFloat;
+    static Stats stats;
+
 private:
-    double getPixelColor(double x, double y);
+    static const kernel::RowFunc row, rowFloat;
+    static const kernel::PointsFunc points, pointsFloat;
+
+    // состояние расчета одного уровня
+    struct Pass {
+        int w, h, skip;
+        kernel::RowFunc row;
+        kernel::PointsFunc points;
+        int *steps;
+        float *values;
+        char *known;
+        bool smooth;
+        long long evaluated = 0, filled = 0, total = 0;
+        // точки, отложенные до общего вызова ядра: индекс в картинке и координаты
+        std::vector<int> batch;
+        std::vector<double> batchX, batchY;
+        std::vector<int> batchSteps;
+        std::vector<float> batchValues;
+    };
+
+    // можно ли залить область с одинаковым числом шагов value
+    static bool fillable(const Pass &pass, int value) {
+        return !pass.smooth || value == kernel::MAX_STEPS;
+    }
+
+    void colorize(int step);
+
+    long long inherit(int step, Pass &pass) const;
+
+    // считает n точек строки i, начиная со столбца j
+    void evaluate(const Pass &pass, int i, int j, int n) const;
+
+    // досчитывает неизвестные точки строки y от x0 до x1 включительно
+    void line(Pass &pass, int y, int x0, int x1) const;
+
+    // откладывает точку (строка i, столбец j), если она еще не известна
+    void defer(Pass &pass, int i, int j) const;
+
+    // считает все отложенные точки; false, если расчет отменили
+    bool flush(Pass &pass, CancelToken token) const;
+
+    bool subdivide(Pass &pass, CancelToken token) const;
+};
+
+// тайл определяется уровнем зума и номером клетки в сетке этого уровня,
+// поэтому после сдвига или возврата на прошлый зум ключи совпадают
+// на глубоком зуме сетка отсчитывается от центра опорной орбиты, anchor -- ее номер
+struct TileKey {
+    // тайлы с разным размером блока лежат на разных сетках, даже если номера совпали
+    int level, anchor, block;
+    long long x, y;
+
+    bool operator<(const TileKey &other) const {
+        return std::tie(level, anchor, block, x, y) <
+               std::tie(other.level, other.anchor, other.block, other.x, other.y);
+    }
+};
+
+// LRU по тайлам с ограничением по памяти на картинки
+class TileCache {
+    using Entry = std::pair<TileKey, std::shared_ptr<RenderFrame>>;
+
+    std::list<Entry> lru;
+    std::map<TileKey, std::list<Entry>::iterator> map;
+    size_t budget, used = 0;
+    size_t hitCount = 0, missCount = 0;
+
+public:
+    explicit TileCache(size_t budget) : budget(budget) {}
+
+    std::shared_ptr<RenderFrame> find(const TileKey &key);
+
+    // вытесняет самые старые тайлы, но не трогает последние keep штук
+    void insert(const TileKey &key, std::shared_ptr<RenderFrame> frame, size_t keep);
+
+    void clear();
+
+    size_t hits() const {
+        return hitCount;
+    }
+
+    size_t misses() const {
+        return missCount;
+    }
+
+    size_t size() const {
+        return map.size();
+    }
+
+    size_t memory() const {
+        return used;
+    }
 };
 
 class Render {
     int w, h;
-    int block;
-    double zoom;
-    int spaceBorder = 1024;
+    int block = 0;
+    // сколько тайлов запрошено в текущей отрисовке, их вытеснять нельзя
+    size_t touched = 0;
     // shared, тк нужно удалять память, но поток может ее юзать
-    std::map<std::pair<int, int>, std::shared_ptr<RenderFrame>> map;
+    TileCache cache;
 
 public:
-    Render() = default;
+    explicit Render(size_t budget = 256 << 20) : cache(budget) {}
 
     void init(int w, int h, int block);
 
+    void beginFrame() {
+        touched = 0;
+    }
+
     std::shared_ptr<RenderFrame>
-    get(std::pair<int, int> coord, std::complex<double> offset, std::complex<double> center,
-        std::pair<double, double> p, int step);
+    get(TileKey key, std::complex<double> offset, std::complex<double> center,
+        std::pair<double, double> p, int step, std::shared_ptr<const ReferenceOrbit> ref = nullptr);
+
+    const TileCache &getCache() const {
+        return cache;
+    }
 };
 
 #endif // RENDER_H
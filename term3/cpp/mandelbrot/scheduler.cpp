@@ -0,0 +1,82 @@
+#include "scheduler.h"
+
+TileScheduler::TileScheduler(size_t workers, int levels) {
+    for (size_t i = 0; i < workers; i++) {
+        this->workers.push_back(std::make_unique<Worker>());
+        this->workers.back()->levels.resize(levels);
+    }
+}
+
+void TileScheduler::push(Task task) {
+    Worker &worker = *workers[next.fetch_add(1) % workers.size()];
+    {
+        std::lock_guard lock(worker.mut);
+        // до того, как задачу можно взять: иначе take() вычтет раньше и
+        // беззнаковый счетчик на мгновение перевалит через ноль
+        pending.fetch_add(1);
+        worker.levels[task.step].push_back(std::move(task));
+    }
+    // спящий поток либо увидит pending, либо мы увидим его в sleeping
+    if (sleeping.load() > 0) {
+        std::lock_guard lock(sleepMut);
+        cv.notify_one();
+    }
+}
+
+bool TileScheduler::take(Worker &worker, Task &task, bool steal) {
+    std::lock_guard lock(worker.mut);
+    for (int i = (int) worker.levels.size() - 1; i >= 0; i--) {
+        auto &deque = worker.levels[i];
+        if (deque.empty()) continue;
+        // хозяин берет с головы, вор -- с хвоста, так они реже пересекаются
+        if (steal) {
+            task = std::move(deque.back());
+            deque.pop_back();
+        } else {
+            task = std::move(deque.front());
+            deque.pop_front();
+        }
+        pending.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+bool TileScheduler::pop(size_t self, Task &task) {
+    while (!stopped.load()) {
+        bool found = take(*workers[self], task, false);
+        for (size_t i = 1; !found && i < workers.size(); i++) {
+            found = take(*workers[(self + i) % workers.size()], task, true);
+        }
+        if (found) {
+            if (!task.token.cancelled()) return true;
+            task.frame->work.store(false);
+            continue;
+        }
+
+        std::unique_lock lock(sleepMut);
+        sleeping.fetch_add(1);
+        cv.wait(lock, [&] { return pending.load() > 0 || stopped.load(); });
+        sleeping.fetch_sub(1);
+    }
+    return false;
+}
+
+void TileScheduler::clear() {
+    for (auto &worker: workers) {
+        std::lock_guard lock(worker->mut);
+        for (auto &deque: worker->levels) {
+            for (auto &task: deque) {
+                task.frame->work.store(false);
+            }
+            pending.fetch_sub(deque.size());
+            deque.clear();
+        }
+    }
+}
+
+void TileScheduler::stop() {
+    std::lock_guard lock(sleepMut);
+    stopped.store(true);
+    cv.notify_all();
+}
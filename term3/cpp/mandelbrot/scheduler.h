@@ -0,0 +1,58 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "render.h"
+
+// у каждого потока своя очередь (по деку на уровень детализации), поток берет
+// задачи из своей, а когда она пуста -- ворует у соседей. Общий мьютекс нужен
+// только чтобы уснуть, когда задач нет совсем
+class TileScheduler {
+public:
+    struct Task {
+        std::shared_ptr<RenderFrame> frame;
+        int step;
+        CancelToken token;
+        // где тайл лежит в сетке, чтобы о готовности можно было сообщить окну
+        TileKey key{};
+    };
+
+    TileScheduler(size_t workers, int levels);
+
+    void push(Task task);
+
+    // блокируется, пока не появится задача; false -- планировщик остановлен.
+    // Отмененные задачи выкидываются, не доходя до потока
+    bool pop(size_t self, Task &task);
+
+    void clear();
+
+    void stop();
+
+    size_t size() const {
+        return pending.load();
+    }
+
+private:
+    struct Worker {
+        std::mutex mut;
+        // чем больше уровень, тем грубее картинка и тем раньше ее надо посчитать
+        std::vector<std::deque<Task>> levels;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> pending = 0, next = 0;
+    std::atomic<int> sleeping = 0;
+    std::atomic<bool> stopped = false;
+    std::mutex sleepMut;
+    std::condition_variable cv;
+
+    bool take(Worker &worker, Task &task, bool steal);
+};
+
+#endif // SCHEDULER_H
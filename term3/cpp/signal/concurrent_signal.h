@@ -0,0 +1,205 @@
+#pragma once
+#include "slot_function.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace signals {
+
+template <typename T>
+struct concurrent_signal;
+
+// Сигнал для многих потоков. Рассылка без замков идет по неизменяемому
+// снимку списка слотов, а connect и disconnect по очереди (под мьютексом)
+// собирают новый снимок и атомарно его публикуют; старый живет, пока его
+// дочитывают идущие рассылки (у снимка свой счетчик ссылок).
+//
+// Гарантии:
+// - слот, подключенный во время рассылки, в нее не попадает;
+// - перед вызовом каждого слота проверяется, не отключен ли он, так что
+//   слот, отключенный в том же потоке (например, из другого слота), уже не
+//   вызовется; но если disconnect() в другом потоке случился после этой
+//   проверки, слот выполнится еще один раз;
+// - disconnect() не ждет уже идущих вызовов слота, поэтому то, что слот
+//   использует, должно пережить и их;
+// - один слот может выполняться в нескольких потоках сразу.
+// Сигнал можно разрушить и из слота: рассылка дойдет по своему снимку до
+// конца. Соединения переживают сигнал и отключаются вхолостую.
+template <typename... Args>
+struct concurrent_signal<void(Args...)> {
+  using slot_t = slot_function<void(Args...)>;
+
+private:
+  struct entry {
+    explicit entry(slot_t slot_) : slot(std::move(slot_)) {}
+
+    slot_t slot;
+    std::atomic<bool> connected = true;
+  };
+
+  struct snapshot {
+    std::atomic<std::size_t> refs = 1;
+    std::vector<std::shared_ptr<entry>> slots;
+  };
+  struct release_snapshot {
+    void operator()(snapshot* s) const noexcept {
+      if (s->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete s;
+      }
+    }
+  };
+  using snapshot_ptr = std::unique_ptr<snapshot, release_snapshot>;
+
+  // Читатель не может взять ссылку на снимок одним атомарным действием:
+  // между чтением указателя и увеличением счетчика снимок могли бы
+  // освободить. Поэтому это делается внутри короткого окна, учтенного в
+  // window[epoch & 1]. Писатель после публикации переключает эпоху и ждет,
+  // пока опустеют окна старой четности; новые читатели попадают в другую
+  // четность и видят уже новый снимок, так что ожидание конечно.
+  struct state {
+    std::mutex writers;
+    std::atomic<snapshot*> current = new snapshot();
+    std::atomic<unsigned> epoch = 0;
+    std::atomic<std::size_t> window[2] = {0, 0};
+
+    ~state() {
+      release_snapshot()(current.load(std::memory_order_relaxed));
+    }
+
+    snapshot_ptr acquire() noexcept {
+      unsigned e;
+      while (true) {
+        e = epoch.load();
+        window[e & 1].fetch_add(1);
+        // эпоха могла смениться до входа в окно, тогда писатель его не ждет
+        if (epoch.load() == e) {
+          break;
+        }
+        window[e & 1].fetch_sub(1);
+      }
+      snapshot* s = current.load();
+      s->refs.fetch_add(1, std::memory_order_relaxed);
+      window[e & 1].fetch_sub(1, std::memory_order_release);
+      return snapshot_ptr(s);
+    }
+
+    // вызывается под writers; старый снимок отпускается на выходе, когда
+    // никто уже не может взять на него новую ссылку
+    void publish(snapshot_ptr next) noexcept {
+      snapshot_ptr old(current.exchange(next.release()));
+      unsigned e = epoch.fetch_add(1);
+      // seq_cst, как и у читателя: это рукопожатие Деккера (запись эпохи,
+      // чтение окна против записи окна, чтения эпохи), с acquire писатель мог
+      // бы увидеть пустое окно, когда читатель в нем уже со старой эпохой
+      while (window[e & 1].load() != 0) {
+        std::this_thread::yield();
+      }
+    }
+
+    void add(std::shared_ptr<entry> e) {
+      std::lock_guard lock(writers);
+      snapshot_ptr next(new snapshot());
+      next->slots = current.load(std::memory_order_relaxed)->slots;
+      next->slots.push_back(std::move(e));
+      publish(std::move(next));
+    }
+
+    void remove(entry const* e) {
+      std::lock_guard lock(writers);
+      auto const& cur = current.load(std::memory_order_relaxed)->slots;
+      snapshot_ptr next(new snapshot());
+      next->slots.reserve(cur.size());
+      for (auto const& other : cur) {
+        if (other.get() != e) {
+          next->slots.push_back(other);
+        }
+      }
+      publish(std::move(next));
+    }
+  };
+
+public:
+  class connection {
+    friend struct concurrent_signal;
+    std::weak_ptr<state> owner;
+    std::shared_ptr<entry> slot;
+
+    connection(std::weak_ptr<state> owner_, std::shared_ptr<entry> slot_)
+        : owner(std::move(owner_)), slot(std::move(slot_)) {}
+
+  public:
+    connection() = default;
+
+    connection(const connection& other) = delete;
+    connection& operator=(const connection& other) = delete;
+    connection(connection&& other) noexcept = default;
+    connection& operator=(connection&& other) {
+      if (this != &other) {
+        disconnect();
+        owner = std::move(other.owner);
+        slot = std::move(other.slot);
+      }
+      return *this;
+    }
+
+    void disconnect() {
+      if (slot == nullptr) {
+        return;
+      }
+      slot->connected.store(false, std::memory_order_release);
+      if (auto sig = owner.lock()) {
+        sig->remove(slot.get());
+      }
+      owner.reset();
+      slot.reset();
+    }
+
+    ~connection() {
+      disconnect();
+    }
+  };
+
+  concurrent_signal() : st(std::make_shared<state>()) {}
+  concurrent_signal(concurrent_signal const&) = delete;
+  concurrent_signal& operator=(concurrent_signal const&) = delete;
+
+  // Копирует список слотов, так что стоит O(числа слотов); рассчитано на
+  // то, что подключаются реже, чем рассылают
+  connection connect(slot_t slot) {
+    auto e = std::make_shared<entry>(std::move(slot));
+    st->add(e);
+    return connection(st, std::move(e));
+  }
+  template <typename T>
+  connection connect(T* obj, void (T::*method)(Args...)) {
+    return connect(slot_t(obj, method));
+  }
+  template <typename T>
+  connection connect(T const* obj, void (T::*method)(Args...) const) {
+    return connect(slot_t(obj, method));
+  }
+
+  // После взятия снимка сигнал больше не трогается
+  void operator()(Args... args) const {
+    snapshot_ptr cur = st->acquire();
+    for (std::size_t i = 0; i < cur->slots.size(); i++) {
+      auto const& e = cur->slots[i];
+      if (!e->connected.load(std::memory_order_acquire)) {
+        continue;
+      }
+      // перемещать аргументы можно только в последний слот снимка
+      if (i + 1 == cur->slots.size()) {
+        e->slot(std::forward<Args>(args)...);
+      } else {
+        e->slot(share_arg<Args>(args)...);
+      }
+    }
+  }
+
+private:
+  std::shared_ptr<state> st;
+};
+
+} // namespace signals
@@ -0,0 +1,163 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <tuple>
+#include <utility>
+
+namespace signals {
+
+// Очередь задач одного потока-получателя (его цикла событий). Класть можно
+// из любых потоков, выполнять -- только владельцу. Внутри -- интрузивная MPSC
+// очередь Вьюкова: вставка -- один exchange, без замков и ожиданий.
+class dispatch_queue {
+  struct task {
+    std::atomic<task*> next = nullptr;
+
+    virtual ~task() = default;
+    virtual void run() {}
+  };
+
+  template <typename F>
+  struct task_impl : task {
+    explicit task_impl(F f_) : f(std::move(f_)) {}
+
+    void run() override {
+      f();
+    }
+
+    F f;
+  };
+
+public:
+  dispatch_queue() = default;
+  dispatch_queue(dispatch_queue const&) = delete;
+  dispatch_queue& operator=(dispatch_queue const&) = delete;
+
+  // Невыполненные задачи просто удаляются
+  ~dispatch_queue() {
+    while (task* t = pop()) {
+      delete t;
+    }
+  }
+
+  // Из любого потока
+  template <typename F>
+  void post(F&& f) {
+    push(new task_impl<std::decay_t<F>>(std::forward<F>(f)));
+    posted.fetch_add(1, std::memory_order_release);
+    posted.notify_one();
+  }
+
+  // Выполняет до limit задач в порядке постановки (для одного
+  // отправителя), возвращает сколько выполнено. Если задача бросила
+  // исключение, оно летит дальше, остальные задачи остаются в очереди.
+  std::size_t run(std::size_t limit = std::numeric_limits<std::size_t>::max()) {
+    seen = posted.load(std::memory_order_acquire);
+    std::size_t done = 0;
+    while (done < limit) {
+      std::unique_ptr<task> t(pop());
+      if (t == nullptr) {
+        break;
+      }
+      done++;
+      t->run();
+    }
+    return done;
+  }
+
+  // Ждет, пока после начала последнего run() не положат что-нибудь еще
+  void wait() const {
+    posted.wait(seen, std::memory_order_acquire);
+  }
+
+private:
+  void push(task* t) noexcept {
+    t->next.store(nullptr, std::memory_order_relaxed);
+    task* prev = head.exchange(t, std::memory_order_acq_rel);
+    prev->next.store(t, std::memory_order_release);
+  }
+
+  // nullptr, если задач нет или отправитель еще не довязал свою
+  task* pop() noexcept {
+    task* t = tail;
+    task* next = t->next.load(std::memory_order_acquire);
+    if (t == &stub) {
+      if (next == nullptr) {
+        return nullptr;
+      }
+      tail = next;
+      t = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next != nullptr) {
+      tail = next;
+      return t;
+    }
+    if (t != head.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    // t последняя: чтобы ее отдать, за ней должен кто-то стоять
+    push(&stub);
+    next = t->next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+      tail = next;
+      return t;
+    }
+    return nullptr;
+  }
+
+  task stub;
+  std::atomic<task*> head = &stub;
+  task* tail = &stub;
+  std::atomic<std::size_t> posted = 0;
+  std::size_t seen = 0;
+};
+
+// Слот, который не вызывается при рассылке, а ставится в очередь
+// получателя: аргументы копируются один раз в задачу, а выполнит ее поток,
+// разбирающий очередь. Как в Qt, disconnect() уже поставленные вызовы не
+// отменяет, а вот с разрушением слота (вместе с соединением или сигналом)
+// еще не начатые вызовы отбрасываются. Очередь должна пережить соединение.
+template <typename F>
+class queued_slot {
+  struct target {
+    explicit target(F f_) : f(std::move(f_)) {}
+
+    F f;
+    std::atomic<bool> connected = true;
+  };
+
+public:
+  queued_slot(dispatch_queue& queue_, F f) : queue(&queue_), slot(std::make_shared<target>(std::move(f))) {}
+
+  queued_slot(queued_slot&& other) noexcept = default;
+  queued_slot& operator=(queued_slot&& other) = delete;
+
+  ~queued_slot() {
+    if (slot != nullptr) {
+      slot->connected.store(false, std::memory_order_release);
+    }
+  }
+
+  template <typename... Ts>
+  void operator()(Ts const&... args) const {
+    queue->post([slot = slot, args = std::tuple<Ts...>(args...)]() mutable {
+      if (slot->connected.load(std::memory_order_acquire)) {
+        std::apply(slot->f, std::move(args));
+      }
+    });
+  }
+
+private:
+  dispatch_queue* queue;
+  std::shared_ptr<target> slot;
+};
+
+template <typename F>
+queued_slot<std::decay_t<F>> queued(dispatch_queue& queue, F&& f) {
+  return queued_slot<std::decay_t<F>>(queue, std::forward<F>(f));
+}
+
+} // namespace signals
@@ -1,6 +1,7 @@
 #pragma once
 #include "intrusive_list.h"
-#include <functional>
+#include "slot_function.h"
+#include <iterator>
 
 // Чтобы не было коллизий с UNIX-сигналами реализация вынесена в неймспейс, по
 // той же причине изменено и название файла
@@ -13,7 +14,7 @@ struct connection_tag {};
 
 template <typename... Args>
 struct signal<void(Args...)> {
-  using slot_t = std::function<void(Args...)>;
+  using slot_t = slot_function<void(Args...)>;
   class connection : public intrusive::list_element<connection_tag> {
     friend struct signal;
     signal* sig = nullptr;
@@ -55,13 +56,10 @@ struct signal<void(Args...)> {
       return *this;
     }
 
+    // O(1): идущие рассылки держат в списке свои курсоры и не ссылаются на
+    // сами соединения, так что узел можно просто вынуть
     void disconnect() {
       if (sig != nullptr) {
-        for (iterator_holder* it = sig->tail; it != nullptr; it = it->prev) {
-          if (&*it->current == this) {
-            it->current++;
-          }
-        }
         this->unlink();
         sig = nullptr;
       }
@@ -80,23 +78,45 @@ struct signal<void(Args...)> {
       it->sig = nullptr;
       it->func = nullptr;
     }
-    for (iterator_holder* it = this->tail; it != nullptr; it = it->prev) {
-      it->sig = nullptr;
+    if (destroyed != nullptr) {
+      *destroyed = true;
     }
     connections.clear();
   }
 
-  connection connect(std::function<void(Args...)> slot) noexcept {
+  // Лямбды с небольшим захватом, указатели на функции и методы хранятся в
+  // соединении без выделения памяти
+  connection connect(slot_t slot) noexcept {
     return connection(this, std::move(slot));
   }
+  template <typename T>
+  connection connect(T* obj, void (T::*method)(Args...)) noexcept {
+    return connect(slot_t(obj, method));
+  }
+  template <typename T>
+  connection connect(T const* obj, void (T::*method)(Args...) const) noexcept {
+    return connect(slot_t(obj, method));
+  }
 
+  // Перед вызовом слота курсор рассылки переставляется за него, поэтому
+  // отключение и перемещение соединений во время рассылки ничего не ломают
   void operator()(Args... args) const {
-    iterator_holder holder(this);
-    while (holder.current != connections.end()) {
-      auto copy = holder.current;
-      holder.current++;
-      (*copy)(std::forward<Args>(args)...);
-      if (holder.sig == nullptr) {
+    emission cur(this);
+    for (auto it = std::next(cur.cursor()); it != connections.end();
+         it = std::next(cur.cursor())) {
+      connections.insert(std::next(it), cur.position);
+      // курсоры вложенных рассылок просто пропускаются
+      if (it->sig == nullptr) {
+        continue;
+      }
+      // аргументы перемещаются только в последний слот; подключенные им
+      // же во время вызова слоты увидят уже перемещенные значения
+      if (last(cur.cursor())) {
+        (*it)(std::forward<Args>(args)...);
+      } else {
+        (*it)(share_arg<Args>(args)...);
+      }
+      if (*cur.destroyed) {
         return;
       }
     }
@@ -106,24 +126,49 @@ private:
   using connections_list = intrusive::list<connection, connection_tag>;
   using connection_iterator = typename connections_list::iterator;
 
-  struct iterator_holder {
-    explicit iterator_holder(const signal* sig_) : sig(sig_), current(sig->connections.begin()), prev(sig->tail) {
-      sig->tail = this;
+  // есть ли за позицией еще соединения, кроме курсоров
+  bool last(connection_iterator pos) const noexcept {
+    for (++pos; pos != connections.end(); ++pos) {
+      if (pos->sig != nullptr) {
+        return false;
+      }
     }
+    return true;
+  }
 
-    ~iterator_holder() {
-      if (sig != nullptr) {
-        sig->tail = sig->tail->prev;
+  // Состояние одной рассылки: курсор -- пустое соединение (sig == nullptr)
+  // в самом списке, сразу за последним вызванным слотом. Флаг разрушения
+  // сигнала заводит самая внешняя рассылка, вложенные пользуются им же.
+  struct emission {
+    explicit emission(const signal* sig_) : sig(sig_), destroyed(sig->destroyed) {
+      if (destroyed == nullptr) {
+        destroyed = sig->destroyed = &flag;
+      }
+      sig->connections.push_front(position);
+    }
+
+    connection_iterator cursor() noexcept {
+      return connection_iterator(&position);
+    }
+
+    // после разрушения сигнала соседи курсора уже могли умереть
+    ~emission() {
+      if (!*destroyed) {
+        position.unlink();
+        if (destroyed == &flag) {
+          sig->destroyed = nullptr;
+        }
       }
     }
 
     const signal* sig;
-    typename connections_list::const_iterator current;
-    iterator_holder* prev;
+    bool* destroyed;
+    bool flag = false;
+    connection position;
   };
 
-  connections_list connections;
-  mutable iterator_holder* tail = nullptr;
+  mutable connections_list connections;
+  mutable bool* destroyed = nullptr;
 };
 
 } // namespace signals
@@ -0,0 +1,184 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace signals {
+
+template <typename Signature, std::size_t Size = 48>
+class slot_function;
+
+// Замена std::function для слотов: только перемещается, объекты до Size байт
+// с nothrow-перемещением хранит в себе, остальные -- в куче. Для тривиально
+// копируемых объектов (указатели на функции, методы с объектом, лямбды,
+// захватившие несколько указателей) перемещение -- memcpy, а разрушать нечего.
+template <typename R, typename... Args, std::size_t Size>
+class slot_function<R(Args...), Size> {
+  static_assert(Size >= sizeof(void*), "buffer must hold at least a pointer");
+
+  // перемещение разрушает источник
+  struct ops {
+    void (*move)(void* from, void* to) noexcept;
+    void (*destroy)(void* buf) noexcept;
+  };
+
+  template <typename F>
+  static constexpr bool fits_inline = sizeof(F) <= Size && alignof(F) <= alignof(std::max_align_t) &&
+                                      std::is_nothrow_move_constructible_v<F>;
+
+  template <typename F>
+  static constexpr bool trivial = fits_inline<F> && std::is_trivially_copyable_v<F>;
+
+  template <typename F>
+  static F* target(void* buf) noexcept {
+    if constexpr (fits_inline<F>) {
+      return std::launder(static_cast<F*>(buf));
+    } else {
+      return *static_cast<F**>(buf);
+    }
+  }
+
+  template <typename F>
+  static R call(void* buf, Args&&... args) {
+    return std::invoke(*target<F>(buf), std::forward<Args>(args)...);
+  }
+
+  template <typename F>
+  static constexpr ops ops_for = {
+      [](void* from, void* to) noexcept {
+        if constexpr (fits_inline<F>) {
+          ::new (to) F(std::move(*target<F>(from)));
+          target<F>(from)->~F();
+        } else {
+          *static_cast<F**>(to) = target<F>(from);
+        }
+      },
+      [](void* buf) noexcept {
+        if constexpr (fits_inline<F>) {
+          target<F>(buf)->~F();
+        } else {
+          delete target<F>(buf);
+        }
+      }};
+
+  // метод вместе с объектом -- три указателя, в буфер помещается всегда
+  template <typename T, typename Method>
+  struct bound_method {
+    T* obj;
+    Method method;
+
+    R operator()(Args... args) const {
+      return (obj->*method)(std::forward<Args>(args)...);
+    }
+  };
+
+  template <typename F>
+  static bool is_null(F const& f) noexcept {
+    if constexpr (std::is_pointer_v<F> || std::is_member_pointer_v<F>) {
+      return f == nullptr;
+    } else {
+      return false;
+    }
+  }
+
+public:
+  slot_function() noexcept = default;
+  slot_function(std::nullptr_t) noexcept {}
+
+  template <typename F, typename D = std::decay_t<F>>
+    requires(!std::is_same_v<D, slot_function> && std::is_invocable_r_v<R, D&, Args...>)
+  slot_function(F&& f) {
+    if (is_null(f)) {
+      return;
+    }
+    if constexpr (fits_inline<D>) {
+      ::new (static_cast<void*>(buf)) D(std::forward<F>(f));
+    } else {
+      *reinterpret_cast<D**>(buf) = new D(std::forward<F>(f));
+    }
+    invoker = &call<D>;
+    if constexpr (!trivial<D>) {
+      manager = &ops_for<D>;
+    }
+  }
+
+  template <typename T>
+  slot_function(T* obj, R (T::*method)(Args...)) noexcept
+      : slot_function(bound_method<T, R (T::*)(Args...)>{obj, method}) {}
+  template <typename T>
+  slot_function(T const* obj, R (T::*method)(Args...) const) noexcept
+      : slot_function(bound_method<T const, R (T::*)(Args...) const>{obj, method}) {}
+
+  slot_function(slot_function&& other) noexcept {
+    take(other);
+  }
+  slot_function& operator=(slot_function&& other) noexcept {
+    if (this != &other) {
+      reset();
+      take(other);
+    }
+    return *this;
+  }
+  slot_function& operator=(std::nullptr_t) noexcept {
+    reset();
+    return *this;
+  }
+
+  ~slot_function() {
+    reset();
+  }
+
+  explicit operator bool() const noexcept {
+    return invoker != nullptr;
+  }
+
+  // Вызов пустой обертки бросает std::bad_function_call, как у std::function
+  R operator()(Args... args) const {
+    if (invoker == nullptr) {
+      throw std::bad_function_call();
+    }
+    return invoker(const_cast<unsigned char*>(buf), std::forward<Args>(args)...);
+  }
+
+private:
+  void take(slot_function& other) noexcept {
+    if (other.manager != nullptr) {
+      other.manager->move(other.buf, buf);
+    } else if (other.invoker != nullptr) {
+      std::memcpy(buf, other.buf, Size);
+    }
+    invoker = std::exchange(other.invoker, nullptr);
+    manager = std::exchange(other.manager, nullptr);
+  }
+
+  void reset() noexcept {
+    if (manager != nullptr) {
+      manager->destroy(buf);
+    }
+    invoker = nullptr;
+    manager = nullptr;
+  }
+
+  // обнулен заранее: тривиальный объект копируется вместе с хвостом буфера
+  alignas(std::max_align_t) unsigned char buf[Size]{};
+  R (*invoker)(void*, Args&&...) = nullptr;
+  // nullptr, если объект тривиальный или его нет
+  ops const* manager = nullptr;
+};
+
+// Аргумент рассылки для слота, за которым будут еще слоты: переданное по
+// значению отдается lvalue (каждый слот получит свою копию), ссылки -- как
+// есть. Перемещать аргументы можно только в последний слот
+template <typename T>
+decltype(auto) share_arg(std::remove_reference_t<T>& arg) noexcept {
+  if constexpr (std::is_rvalue_reference_v<T>) {
+    return std::move(arg);
+  } else {
+    return (arg);
+  }
+}
+
+} // namespace signals
@@ -0,0 +1,8 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Сколько раз программа звала глобальный operator new. Замена operator new
+// лежит в отдельной единице трансляции: в одной с тестами GCC видит пары
+// new/free после встраивания и ругается -Wmismatched-new-delete
+extern std::atomic<std::size_t> allocations;
@@ -1,5 +1,14 @@
+#include "concurrent_signal.h"
+#include "dispatch_queue.h"
 #include "signals.h"
+#include "test-allocations.h"
 #include "gtest/gtest.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 TEST(signal_testing, trivial) {
   signals::signal<void()> sig;
@@ -30,6 +39,30 @@ TEST(signal_testing, arguments) {
   sig(5, 6, 7);
 }
 
+TEST(signal_testing, rvalue_reference_arguments) {
+  signals::signal<void(std::unique_ptr<int>&&)> sig;
+  std::unique_ptr<int> taken;
+  auto conn1 = sig.connect([&](std::unique_ptr<int>&& p) { EXPECT_EQ(42, *p); });
+  auto conn2 = sig.connect([&](std::unique_ptr<int>&& p) { taken = std::move(p); });
+
+  sig(std::make_unique<int>(42));
+  ASSERT_NE(nullptr, taken);
+  EXPECT_EQ(42, *taken);
+}
+
+TEST(signal_testing, value_arguments_moved_into_last_slot) {
+  signals::signal<void(std::string)> sig;
+  std::string first, second;
+  auto conn1 = sig.connect([&](std::string s) { first = std::move(s); });
+  auto conn2 = sig.connect([&](std::string s) { second = std::move(s); });
+  auto conn3 = sig.connect([](std::string const&) {});
+  conn3.disconnect();
+
+  sig(std::string(100, 'a'));
+  EXPECT_EQ(std::string(100, 'a'), first);
+  EXPECT_EQ(std::string(100, 'a'), second);
+}
+
 TEST(signal_testing, empty_connection_move) {
   signals::signal<void()>::connection a;
   signals::signal<void()>::connection b = std::move(a);
@@ -112,6 +145,33 @@ TEST(signal_testing, disconnect_in_emit) {
   EXPECT_EQ(2, got3);
 }
 
+TEST(signal_testing, disconnect_many_in_recursive_emit) {
+  using connection = signals::signal<void()>::connection;
+  signals::signal<void()> sig;
+  std::vector<connection> conns;
+  std::vector<uint32_t> got(100);
+  uint32_t depth = 0;
+  conns.push_back(sig.connect([&] {
+    if (depth++ == 0) {
+      sig();
+      // внешняя рассылка стоит сразу за этим слотом, внутренняя уже прошла
+      // весь список; выключаем каждый второй из оставшихся
+      for (size_t i = 1; i < conns.size(); i += 2) {
+        conns[i].disconnect();
+      }
+    }
+  }));
+  for (size_t i = 0; i < got.size(); i++) {
+    conns.push_back(sig.connect([&, i] { ++got[i]; }));
+  }
+
+  sig();
+
+  for (size_t i = 0; i < got.size(); i++) {
+    EXPECT_EQ(i % 2 == 0 ? 1 : 2, got[i]);
+  }
+}
+
 TEST(signal_testing, destroy_signal_before_connection_01) {
   auto sig = std::make_unique<signals::signal<void()>>();
   uint32_t got1 = 0;
@@ -253,6 +313,216 @@ TEST(signal_testing, move_in_emit_02) {
   EXPECT_EQ(1, got1);
 }
 
+namespace {
+int free_calls = 0;
+void free_slot(int x) {
+  free_calls += x;
+}
+
+struct counter {
+  int calls = 0;
+  void add(int x) {
+    calls += x;
+  }
+  void check(int x) const {
+    EXPECT_EQ(calls, x);
+  }
+};
+} // namespace
+
+TEST(signal_testing, connect_without_allocation) {
+  signals::signal<void(int)> sig;
+  counter c;
+  int a = 0, b = 0, d = 0;
+  size_t before = allocations;
+  auto conn1 = sig.connect([&a, &b, &d](int x) { a += x, b += x, d += x; });
+  auto conn2 = sig.connect(&free_slot);
+  auto conn3 = sig.connect(&c, &counter::add);
+  auto conn4 = sig.connect(&std::as_const(c), &counter::check);
+  sig(2);
+  EXPECT_EQ(before, allocations);
+  EXPECT_EQ(6, a + b + d);
+  EXPECT_EQ(2, free_calls);
+  EXPECT_EQ(2, c.calls);
+}
+
+TEST(signal_testing, large_and_move_only_slots) {
+  signals::signal<void()> sig;
+  std::array<int, 64> big{};
+  big[63] = 1;
+  int sum = 0;
+  auto conn1 = sig.connect([big, &sum] { sum += big[63]; });
+  auto owned = std::make_unique<int>(10);
+  auto conn2 = sig.connect([owned = std::move(owned), &sum] { sum += *owned; });
+
+  sig();
+  auto moved = std::move(conn2);
+  sig();
+
+  EXPECT_EQ(22, sum);
+}
+
+TEST(signal_testing, empty_slot_function) {
+  signals::slot_function<void()> f;
+  EXPECT_FALSE(f);
+  EXPECT_THROW(f(), std::bad_function_call);
+  void (*null)() = nullptr;
+  EXPECT_FALSE(signals::slot_function<void()>(null));
+  f = [] {};
+  EXPECT_TRUE(f);
+  f = nullptr;
+  EXPECT_FALSE(f);
+}
+
+TEST(concurrent_signal_testing, disconnect_in_emit) {
+  using connection = signals::concurrent_signal<void()>::connection;
+  auto sig = std::make_unique<signals::concurrent_signal<void()>>();
+  uint32_t got1 = 0, got2 = 0, got3 = 0;
+  connection conn3;
+  connection conn1 = sig->connect([&] {
+    ++got1;
+    conn3.disconnect();
+  });
+  connection conn2 = sig->connect([&] {
+    ++got2;
+    if (got2 == 2) {
+      sig.reset();
+    }
+  });
+  conn3 = sig->connect([&] { ++got3; });
+
+  (*sig)();
+  EXPECT_EQ(1, got2);
+  EXPECT_EQ(0, got3);
+
+  (*sig)();
+  EXPECT_EQ(2, got1);
+  EXPECT_EQ(2, got2);
+  EXPECT_EQ(nullptr, sig);
+}
+
+TEST(concurrent_signal_testing, rvalue_reference_arguments) {
+  signals::concurrent_signal<void(std::unique_ptr<int>&&)> sig;
+  std::unique_ptr<int> taken;
+  auto conn1 = sig.connect([&](std::unique_ptr<int>&& p) { EXPECT_EQ(42, *p); });
+  auto conn2 = sig.connect([&](std::unique_ptr<int>&& p) { taken = std::move(p); });
+
+  sig(std::make_unique<int>(42));
+  ASSERT_NE(nullptr, taken);
+  EXPECT_EQ(42, *taken);
+}
+
+TEST(concurrent_signal_testing, emit_while_connecting) {
+  signals::concurrent_signal<void(int)> sig;
+  std::atomic<int> sum = 0;
+  std::atomic<bool> stop = false;
+  auto keep = sig.connect([&](int x) { sum += x; });
+
+  std::vector<std::thread> emitters;
+  for (int t = 0; t < 3; t++) {
+    emitters.emplace_back([&] {
+      while (!stop) {
+        sig(1);
+      }
+    });
+  }
+  std::thread writer([&] {
+    for (int i = 0; i < 2000; i++) {
+      auto conn = sig.connect([&](int x) { sum += x; });
+      if (i % 2 == 0) {
+        conn.disconnect();
+      }
+    }
+    stop = true;
+  });
+  writer.join();
+  for (auto& th : emitters) {
+    th.join();
+  }
+
+  int before = sum;
+  sig(1);
+  EXPECT_EQ(before + 1, sum);
+}
+
+TEST(dispatch_queue_testing, queued_delivery) {
+  signals::dispatch_queue queue;
+  signals::signal<void(std::string)> sig;
+  std::vector<std::string> direct, delivered;
+  auto conn1 = sig.connect([&](std::string s) { direct.push_back(std::move(s)); });
+  auto conn2 = sig.connect(signals::queued(queue, [&](std::string s) { delivered.push_back(std::move(s)); }));
+
+  sig(std::string(100, 'a'));
+  sig("b");
+  EXPECT_EQ(2, direct.size());
+  EXPECT_TRUE(delivered.empty());
+
+  EXPECT_EQ(1, queue.run(1));
+  EXPECT_EQ(1, queue.run());
+  EXPECT_EQ(0, queue.run());
+  EXPECT_EQ(direct, delivered);
+}
+
+TEST(dispatch_queue_testing, destroyed_slot_drops_pending) {
+  signals::dispatch_queue queue;
+  signals::signal<void(int)> sig;
+  int got = 0;
+  auto conn = std::make_unique<signals::signal<void(int)>::connection>(
+      sig.connect(signals::queued(queue, [&](int x) { got += x; })));
+  sig(1);
+  conn->disconnect();
+  sig(2);
+  EXPECT_EQ(1, queue.run());
+  EXPECT_EQ(1, got);
+
+  *conn = sig.connect(signals::queued(queue, [&](int x) { got += x; }));
+  sig(4);
+  conn.reset();
+  sig(8);
+  EXPECT_EQ(1, queue.run());
+  EXPECT_EQ(1, got);
+}
+
+TEST(dispatch_queue_testing, many_senders) {
+  constexpr int senders = 4, per_sender = 10000;
+  signals::dispatch_queue queue;
+  std::array<std::atomic<int>, senders> next{};
+  int received = 0;
+  bool ordered = true;
+
+  std::thread receiver([&] {
+    while (received < senders * per_sender) {
+      if (queue.run(64) == 0) {
+        queue.wait();
+      }
+    }
+  });
+  std::vector<std::thread> threads;
+  for (int t = 0; t < senders; t++) {
+    threads.emplace_back([&, t] {
+      signals::signal<void(int, int)> sig;
+      auto conn = sig.connect(signals::queued(queue, [&](int from, int i) {
+        ordered &= next[from].load() == i;
+        next[from].store(i + 1);
+        received++;
+      }));
+      for (int i = 0; i < per_sender; i++) {
+        sig(t, i);
+      }
+      // до отключения все должно быть доставлено
+      while (next[t] != per_sender) {
+        std::this_thread::yield();
+      }
+    });
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+  receiver.join();
+  EXPECT_EQ(senders * per_sender, received);
+  EXPECT_TRUE(ordered);
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();